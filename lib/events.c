@@ -72,7 +72,93 @@ static int state_changed(struct wiimote_t *wm);
  *	that occur.  If an event occurs on a particular wiimote,
  *	the event variable will be set.
  */
-int wiiuse_poll(struct wiimote_t **wm, int wiimotes) { return wiiuse_os_poll(wm, wiimotes); }
+int wiiuse_poll(struct wiimote_t **wm, int wiimotes)
+{
+    return wiiuse_poll_timeout(wm, wiimotes, WIIUSE_POLL_TIMEOUT);
+}
+
+/**
+ *	@brief Hand the reports synchronous reads held back to propagate_event().
+ *
+ *	@param wm		An array of pointers to wiimote_t structures.
+ *	@param wiimotes	The number of wiimote_t structures in the \a wm array.
+ *
+ *	@return Returns number of wiimotes that an event has occurred on,
+ *			or -1 if no reports were held back.
+ *
+ *	Held reports arrived before anything still waiting on the wiimotes,
+ *	so the poll is spent on them.  Like a read off the wiimote, a report
+ *	that leaves an event ends the wiimote's turn.
+ */
+static int poll_held_reports(struct wiimote_t **wm, int wiimotes)
+{
+    byte read_buffer[MAX_PAYLOAD];
+    int held = 0;
+    int evnt = 0;
+    int i;
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        if (wm[i]->rx_queue && wm[i]->rx_queue->count)
+        {
+            held = 1;
+            break;
+        }
+    }
+    if (!held)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        wm[i]->event = WIIUSE_NONE;
+
+        /* clear out any old read data */
+        clear_dirty_reads(wm[i]);
+
+        while (wm[i]->event == WIIUSE_NONE && wiiuse_take_report(wm[i], read_buffer))
+        {
+            propagate_event(wm[i], read_buffer[0], read_buffer + 1);
+        }
+        evnt += (wm[i]->event != WIIUSE_NONE);
+    }
+
+    return evnt;
+}
+
+/**
+ *	@brief Poll the wiimotes for any events, waiting as long as the caller likes for one.
+ *
+ *	@param wm			An array of pointers to wiimote_t structures.
+ *	@param wiimotes		The number of wiimote_t structures in the \a wm array.
+ *	@param timeout_ms	How long to wait for a report, 0 to not wait at all, -1 to wait until one arrives.
+ *
+ *	@return Returns number of wiimotes that an event has occurred on.
+ *
+ *	Returns as soon as a report arrives, so a long timeout costs no latency.
+ *	On Windows every wiimote is read with its own timeout instead, see wiiuse_set_timeout().
+ */
+int wiiuse_poll_timeout(struct wiimote_t **wm, int wiimotes, int timeout_ms)
+{
+    int evnt;
+
+    if (!wm)
+    {
+        return 0;
+    }
+
+    /* requests the rate limit held back may be due, and the wait mustn't outlast the next one */
+    timeout_ms = wiiuse_send_held_requests(wm, wiimotes, timeout_ms);
+
+    evnt = poll_held_reports(wm, wiimotes);
+    if (evnt >= 0)
+    {
+        return evnt;
+    }
+
+    return wiiuse_os_poll(wm, wiimotes, timeout_ms);
+}
 
 int wiiuse_update(struct wiimote_t **wiimotes, int nwiimotes, wiiuse_update_cb callback)
 {
@@ -153,7 +239,7 @@ void clear_dirty_reads(struct wiimote_t *wm)
         WIIUSE_DEBUG("Cleared old read request for address: %x", req->addr);
 
         wm->read_req = req->next;
-        free(req);
+        wiiuse_free_read_req(wm, req);
         req = wm->read_req;
     }
 }
@@ -283,16 +369,17 @@ void propagate_event(struct wiimote_t *wm, byte event, byte *msg)
     }
 
     /*
-     * FIXME: this gets triggered only when the Wiimote sends 0x22
-     * Acknowledge output report, return function result. This is unfortunately sent only
-     * rarely, typically when there is an error (e.g. reading from an invalid address) and
-     * *must not* be relied on to call the write callbacks. The report can also appear unsolicited
-     * during synchronous handshake, where it would produce spurious error messages. That's why
-     * it is disabled.
+     * 0x22 Acknowledge output report, return function result. Memory writes (0x16) are
+     * always acknowledged, other output reports only on error. Acks for anything but a
+     * memory write are ignored, and event_data_write() ignores acks nobody queued a request
+     * for, such as the ones produced during the synchronous handshake.
      */
     case WM_RPT_WRITE:
     {
-        /* event_data_write(wm, msg); */
+        if (msg[2] == WM_CMD_WRITE_DATA)
+        {
+            event_data_write(wm, msg);
+        }
         break;
     }
     default:
@@ -350,6 +437,7 @@ static void event_data_read(struct wiimote_t *wm, byte *msg)
     byte err;
     byte len;
     uint16_t offset;
+    uint16_t start;
     struct read_req_t *req = wm->read_req;
 
     wiiuse_pressed_buttons(wm, msg);
@@ -384,9 +472,10 @@ static void event_data_read(struct wiimote_t *wm, byte *msg)
     {
         /* this request errored out, so skip it and go to the next one */
 
-        /* delete this request */
+        /* delete this request, and the answered ones ahead of it */
+        clear_dirty_reads(wm);
         wm->read_req = req->next;
-        free(req);
+        wiiuse_free_read_req(wm, req);
 
         /* if another request exists send it to the wiimote */
         if (wm->read_req)
@@ -397,10 +486,23 @@ static void event_data_read(struct wiimote_t *wm, byte *msg)
         return;
     }
 
-    len       = ((msg[2] & 0xF0) >> 4) + 1;
-    offset    = from_big_endian_uint16_t(msg + 3);
-    req->addr = (req->addr & 0xFFFF);
+    len    = ((msg[2] & 0xF0) >> 4) + 1;
+    offset = from_big_endian_uint16_t(msg + 3);
+    start  = (uint16_t)(req->addr & 0xFFFF);
 
+    /*
+     * the packets of a request come back in order, so one that isn't next
+     * is either after a lost packet or a late copy of one already taken,
+     * the part after a lost packet is asked for again by wiiuse_resend_requests()
+     */
+    if (offset != start + req->size - req->wait)
+    {
+        WIIUSE_DEBUG("Ignoring read packet at offset %i, waiting on %i.", offset,
+                     start + req->size - req->wait);
+        return;
+    }
+
+    ++wm->replies;
     req->wait -= len;
     if (req->wait >= req->size)
     /* this should never happen */
@@ -410,13 +512,13 @@ static void event_data_read(struct wiimote_t *wm, byte *msg)
 
     WIIUSE_DEBUG("Received read packet:");
     WIIUSE_DEBUG("    Packet read offset:   %i bytes", offset);
-    WIIUSE_DEBUG("    Request read offset:  %i bytes", req->addr);
-    WIIUSE_DEBUG("    Read offset into buf: %i bytes", offset - req->addr);
+    WIIUSE_DEBUG("    Request read offset:  %i bytes", start);
+    WIIUSE_DEBUG("    Read offset into buf: %i bytes", offset - start);
     WIIUSE_DEBUG("    Read data size:       %i bytes", len);
     WIIUSE_DEBUG("    Still need:           %i bytes", req->wait);
 
     /* reconstruct this part of the data */
-    memcpy((req->buf + offset - req->addr), (msg + 5), len);
+    memcpy((req->buf + offset - start), (msg + 5), len);
 
 #ifdef WITH_WIIUSE_DEBUG
     {
@@ -438,9 +540,10 @@ static void event_data_read(struct wiimote_t *wm, byte *msg)
             /* this was a callback, so invoke it now */
             req->cb(wm, req->buf, req->size);
 
-            /* delete this request */
+            /* delete this request, and the answered ones ahead of it */
+            clear_dirty_reads(wm);
             wm->read_req = req->next;
-            free(req);
+            wiiuse_free_read_req(wm, req);
         } else
         {
             /*
@@ -469,30 +572,54 @@ static void event_data_write(struct wiimote_t *wm, byte *msg)
 
     wiiuse_pressed_buttons(wm, msg);
 
+    /* finished requests had their cycle to be seen by the client */
+    while (req && req->state == REQ_DONE)
+    {
+        wm->data_req = req->next;
+        wiiuse_free_data_req(wm, req);
+        req = wm->data_req;
+    }
+
     /* if we don't have a request out then we didn't ask for this packet */
-    if (!req)
+    if (!req || req->state != REQ_SENT)
     {
-        WIIUSE_WARNING("Transmitting data packet when no request was made.");
+        WIIUSE_DEBUG("Ignoring write acknowledgement when no request was sent.");
         return;
     }
-    if (!(req->state == REQ_SENT))
+
+    ++wm->replies;
+    if (msg[3])
     {
-        WIIUSE_WARNING("Transmission is not necessary");
-        /* delete this request */
-        wm->data_req = req->next;
-        free(req);
-        return;
+        WIIUSE_WARNING("Unable to write data - error code %x.", msg[3]);
+    }
+
+    /* a vectored write takes an ack for each of its reports, and is done with the last */
+    if (req->iov)
+    {
+        req->status[req->acked++] = msg[3];
+        if (req->acked < req->blocks)
+        {
+            wiiuse_send_next_pending_write_request(wm);
+            return;
+        }
     }
 
+    /* acks come back in the order the writes were sent, so this one is the oldest */
     req->state = REQ_DONE;
 
-    if (req->cb)
+    if (req->cb || (req->iov && req->write_v_cb))
     {
         /* this was a callback, so invoke it now */
-        req->cb(wm, NULL, 0);
+        if (req->iov)
+        {
+            req->write_v_cb(wm, req->status, req->blocks, req->arg);
+        } else
+        {
+            req->cb(wm, NULL, 0);
+        }
         /* delete this request */
         wm->data_req = req->next;
-        free(req);
+        wiiuse_free_data_req(wm, req);
     } else
     {
         /*
@@ -637,14 +764,28 @@ static void event_status(struct wiimote_t *wm, byte *msg)
     {
         return;
     }
-    if (!(req->state == REQ_SENT))
+    if (!(req->state == REQ_SENT) || req->iov)
+    {
+        return;
+    }
+    /*
+     * acks are matched to writes by the order they were sent in, with
+     * more than one write in flight there is no telling which this stands for
+     */
+    if (req->next && req->next->state == REQ_SENT)
     {
         return;
     }
     wm->data_req = req->next;
     req->state   = REQ_DONE;
     /* if(req->cb!=NULL) req->cb(wm,msg,6); */
-    free(req);
+    wiiuse_free_data_req(wm, req);
+
+    /* if another request exists send it to the wiimote */
+    if (wm->data_req)
+    {
+        wiiuse_send_next_pending_write_request(wm);
+    }
 }
 
 /**
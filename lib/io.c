@@ -39,6 +39,7 @@
 #include "os.h" /* for wiiuse_os_* */
 
 #include <stdlib.h> /* for free, malloc */
+#include <string.h> /* for memcpy, memset */
 
 /**
  *  @brief Find a wiimote or wiimotes.
@@ -90,6 +91,31 @@ int wiiuse_find(struct wiimote_t **wm, int max_wiimotes, int timeout)
  */
 int wiiuse_connect(struct wiimote_t **wm, int wiimotes) { return wiiuse_os_connect(wm, wiimotes); }
 
+/**
+ *  @brief Connect straight to a wiimote whose address is already known.
+ *
+ *  @param wm     Pointer to a wiimote_t structure.
+ *  @param address  The bluetooth address of the wiimote, as "XX:XX:XX:XX:XX:XX".
+ *
+ *  @return 1 on success, 0 on failure
+ *
+ *  @see wiiuse_connect()
+ *  @see wiiuse_os_connect_address()
+ *
+ *  No inquiry is run, so a wiimote that was seen before can be
+ *  reconnected without waiting on wiiuse_find().  If the wiimote
+ *  is not in range this fails and wiiuse_find() should be used.
+ *
+ *  This function only delegates to the platform-specific implementation
+ *  wiiuse_os_connect_address.
+ *
+ *  This function is declared in wiiuse.h
+ */
+int wiiuse_connect_address(struct wiimote_t *wm, const char *address)
+{
+    return wiiuse_os_connect_address(wm, address);
+}
+
 /**
  *  @brief Disconnect a wiimote.
  *
@@ -108,46 +134,123 @@ int wiiuse_connect(struct wiimote_t **wm, int wiimotes) { return wiiuse_os_conne
 void wiiuse_disconnect(struct wiimote_t *wm) { wiiuse_os_disconnect(wm); }
 
 /**
-*    @brief Wait until specified report arrives and return it
+*    @brief Hold a report back for wiiuse_poll().
 *
 *    @param wm             Pointer to a wiimote_t structure.
+*    @param buffer         The report, buffer[0] being its type
+*
+*    When the queue is full the oldest report makes room, which is what
+*    would have happened to all of them before.
+*/
+static void wiiuse_hold_report(struct wiimote_t *wm, byte *buffer)
+{
+    struct rx_queue_t *q = wm->rx_queue;
+
+    if (!q)
+    {
+        q = wm->rx_queue = (struct rx_queue_t *)calloc(1, sizeof(struct rx_queue_t));
+        if (!q)
+        {
+            WIIUSE_ERROR("(id %i) out of memory, dropping report 0x%x", wm->unid, buffer[0]);
+            return;
+        }
+    }
+
+    if (q->count == WIIUSE_RX_QUEUE_SIZE)
+    {
+        WIIUSE_WARNING("(id %i) receive queue full, dropping report 0x%x", wm->unid, q->report[q->head][0]);
+        q->head = (q->head + 1) % WIIUSE_RX_QUEUE_SIZE;
+        q->count--;
+    }
+    memcpy(q->report[(q->head + q->count) % WIIUSE_RX_QUEUE_SIZE], buffer, MAX_PAYLOAD);
+    q->count++;
+}
+
+/**
+*    @brief Take the oldest report a synchronous read held back.
+*
+*    @param wm             Pointer to a wiimote_t structure.
+*    @param buffer         MAX_PAYLOAD bytes to store the report in
+*
+*    Returns 1 if there was one, 0 if not.
+*/
+int wiiuse_take_report(struct wiimote_t *wm, byte *buffer)
+{
+    struct rx_queue_t *q = wm->rx_queue;
+
+    if (!q || !q->count)
+    {
+        return 0;
+    }
+
+    memcpy(buffer, q->report[q->head], MAX_PAYLOAD);
+    q->head = (q->head + 1) % WIIUSE_RX_QUEUE_SIZE;
+    q->count--;
+
+    return 1;
+}
+
+/**
+*    @brief Wait until a matching report arrives and return it
+*
+*    @param wm             Pointer to a wiimote_t structure.
+*    @param report         The report type to wait for
+*    @param addr           For WM_RPT_READ, the address the data has to be from, -1 for any
 *    @param buffer         Pre-allocated memory to store the received data
 *    @param bufferLength   size of buffer in bytes
 *    @param timeout_ms     timeout in ms, 0 = wait forever
 *
-*    Synchronous/blocking, this function will not return until it receives the specified
-*    report from the Wiimote or timeout occurs.
+*    It sleeps on the wiimote until a report arrives or the time left runs out,
+*    rather than spinning on reads.  Every other report is held back for
+*    wiiuse_poll(), so button, status and acknowledgement traffic isn't lost.
 *
 *    Returns 1 on success, -1 on failure.
-*
 */
-int wiiuse_wait_report(struct wiimote_t *wm, int report, byte *buffer, int bufferLength,
-                       unsigned long timeout_ms)
+static int wiiuse_wait_matching(struct wiimote_t *wm, int report, long addr, byte *buffer, int bufferLength,
+                                unsigned long timeout_ms)
 {
-
-    int result            = 1;
-    unsigned long elapsed = 0;
-    unsigned long start   = wiiuse_os_ticks();
+    int result       = 1;
+    uint64_t limit   = (uint64_t)timeout_ms * 1000;
+    uint64_t start   = wiiuse_os_ticks_us();
+    uint64_t elapsed = 0;
+    int ready;
 
     for (;;)
     {
-        if (wiiuse_os_read(wm, buffer, bufferLength) > 0)
+        /* a wiimote that hung up has nothing more to send */
+        if (!WIIMOTE_IS_CONNECTED(wm))
+        {
+            result = -1;
+            break;
+        }
+
+        /* round the time left up, a wait cut short by a fraction of a millisecond would just spin */
+        ready = wiiuse_os_wait(wm, timeout_ms ? (int)((limit - elapsed + 999) / 1000) : -1);
+        if (ready < 0)
+        {
+            result = -1;
+            break;
+        }
+
+        memset(buffer, 0, bufferLength);
+        if (ready && wiiuse_os_read(wm, buffer, bufferLength) > 0)
         {
-            if (buffer[0] == report)
+            /* only the low 16 bits of the address come back */
+            if (buffer[0] == report && (addr < 0 || from_big_endian_uint16_t(buffer + 4) == (addr & 0xFFFF)))
             {
                 break;
-            } else
+            }
+
+            if (buffer[0] != 0x30) /* hack for chatty devices spamming the button report */
             {
-                if (buffer[0] != 0x30) /* hack for chatty devices spamming the button report */
-                {
-                    WIIUSE_DEBUG("(id %i) dropping report 0x%x, waiting for 0x%x", wm->unid, buffer[0],
-                                 report);
-                }
+                WIIUSE_DEBUG("(id %i) holding report 0x%x back, waiting for 0x%x", wm->unid, buffer[0],
+                             report);
             }
+            wiiuse_hold_report(wm, buffer);
         }
 
-        elapsed = wiiuse_os_ticks() - start;
-        if (elapsed > timeout_ms && timeout_ms > 0)
+        elapsed = wiiuse_os_ticks_us() - start;
+        if (elapsed >= limit && timeout_ms > 0)
         {
             result = -1;
             break;
@@ -157,6 +260,46 @@ int wiiuse_wait_report(struct wiimote_t *wm, int report, byte *buffer, int buffe
     return result;
 }
 
+/**
+*    @brief Wait until specified report arrives and return it
+*
+*    @param wm             Pointer to a wiimote_t structure.
+*    @param buffer         Pre-allocated memory to store the received data
+*    @param bufferLength   size of buffer in bytes
+*    @param timeout_ms     timeout in ms, 0 = wait forever
+*
+*    Synchronous/blocking, this function will not return until it receives the specified
+*    report from the Wiimote or timeout occurs.
+*
+*    Returns 1 on success, -1 on failure.
+*
+*/
+int wiiuse_wait_report(struct wiimote_t *wm, int report, byte *buffer, int bufferLength,
+                       unsigned long timeout_ms)
+{
+    return wiiuse_wait_matching(wm, report, -1, buffer, bufferLength, timeout_ms);
+}
+
+/**
+*    @brief Wait until the WM_RPT_READ report for an address arrives and return it
+*
+*    @param wm             Pointer to a wiimote_t structure.
+*    @param addr           The address the data has to be from
+*    @param buffer         Pre-allocated memory to store the received data
+*    @param bufferLength   size of buffer in bytes
+*    @param timeout_ms     timeout in ms, 0 = wait forever
+*
+*    Data read for any other request, such as a queued wiiuse_read_data(),
+*    is held back for wiiuse_poll() to hand to its request.
+*
+*    Returns 1 on success, -1 on failure.
+*/
+int wiiuse_wait_read_report(struct wiimote_t *wm, unsigned addr, byte *buffer, int bufferLength,
+                            unsigned long timeout_ms)
+{
+    return wiiuse_wait_matching(wm, WM_RPT_READ, (long)addr, buffer, bufferLength, timeout_ms);
+}
+
 /**
 *    @brief Read memory/register data synchronously
 *
@@ -205,7 +348,7 @@ void wiiuse_read_data_sync(struct wiimote_t *wm, byte memory, unsigned addr, uns
 
         for (i = 0; i < n_full_reports; ++i)
         {
-            int rc = wiiuse_wait_report(wm, WM_RPT_READ, buf, MAX_PAYLOAD, WIIUSE_READ_TIMEOUT);
+            int rc = wiiuse_wait_read_report(wm, addr + i * 16, buf, MAX_PAYLOAD, WIIUSE_READ_TIMEOUT);
 
             if (rc < 0)
                 /* oops, time out, abort and retry */
@@ -218,7 +361,8 @@ void wiiuse_read_data_sync(struct wiimote_t *wm, byte memory, unsigned addr, uns
         /* read the last incomplete packet */
         if (last_report)
         {
-            int rc = wiiuse_wait_report(wm, WM_RPT_READ, buf, MAX_PAYLOAD, WIIUSE_READ_TIMEOUT);
+            int rc = wiiuse_wait_read_report(wm, addr + n_full_reports * 16, buf, MAX_PAYLOAD,
+                                             WIIUSE_READ_TIMEOUT);
 
             if (rc)
                 done = 1;
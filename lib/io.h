@@ -46,6 +46,9 @@ void wiiuse_handshake(struct wiimote_t *wm, byte *data, uint16_t len);
 
 int wiiuse_wait_report(struct wiimote_t *wm, int report, byte *buffer, int bufferLength,
                        unsigned long timeout_ms);
+int wiiuse_wait_read_report(struct wiimote_t *wm, unsigned addr, byte *buffer, int bufferLength,
+                            unsigned long timeout_ms);
+int wiiuse_take_report(struct wiimote_t *wm, byte *buffer);
 void wiiuse_read_data_sync(struct wiimote_t *wm, byte memory, unsigned addr, unsigned short size, byte *data);
 /** @} */
 
@@ -48,14 +48,18 @@ void wiiuse_cleanup_platform_fields(struct wiimote_t *wm);
 int wiiuse_os_find(struct wiimote_t **wm, int max_wiimotes, int timeout);
 
 int wiiuse_os_connect(struct wiimote_t **wm, int wiimotes);
+int wiiuse_os_connect_address(struct wiimote_t *wm, const char *address);
 void wiiuse_os_disconnect(struct wiimote_t *wm);
 
-int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes);
+int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes, int timeout_ms);
+/* 1 once wm has a report to read, 0 if timeout_ms (-1 for ever) passes first, -1 on error */
+int wiiuse_os_wait(struct wiimote_t *wm, int timeout_ms);
 /* buf[0] will be the report type, buf+1 the rest of the report */
 int wiiuse_os_read(struct wiimote_t *wm, byte *buf, int len);
 int wiiuse_os_write(struct wiimote_t *wm, byte report_type, byte *buf, int len);
 
-unsigned long wiiuse_os_ticks();
+/* microseconds on a clock that only moves forward, only the difference between two calls means anything */
+uint64_t wiiuse_os_ticks_us();
 /** @} */
 
 #ifdef __cplusplus
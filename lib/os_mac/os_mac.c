@@ -29,20 +29,16 @@
 
 #include "../os.h"
 
-#ifdef __MACH__
-	#include <mach/clock.h>
-	#include <mach/mach.h>
-#endif
+#include <mach/mach_time.h>
 
-unsigned long wiiuse_os_ticks() {
-	struct timespec ts;
-  	clock_serv_t cclock;
-  	mach_timespec_t mts;
-  	host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &cclock);
-  	clock_get_time(cclock, &mts);
-  	mach_port_deallocate(mach_task_self(), cclock);
-  	ts.tv_sec = mts.tv_sec;
-  	ts.tv_nsec = mts.tv_nsec;
-  	unsigned long ms = 1000 * ts.tv_sec + ts.tv_nsec / 1e6;
-  	return ms;
+uint64_t wiiuse_os_ticks_us() {
+	static mach_timebase_info_data_t timebase;
+	uint64_t ticks = mach_absolute_time();
+
+	/* the absolute time never goes back, unlike the calendar clock */
+	if (!timebase.denom)
+		mach_timebase_info(&timebase);
+	/* split the ticks so the conversion to nanoseconds can't overflow */
+	return ((ticks / timebase.denom) * timebase.numer +
+	        (ticks % timebase.denom) * timebase.numer / timebase.denom) / 1000;
 }
@@ -126,6 +126,12 @@ int wiiuse_os_connect(struct wiimote_t** wm, int wiimotes) {
 	return connected;
 }
 
+int wiiuse_os_connect_address(struct wiimote_t* wm, const char* address) {
+	// devices are only known through the IOBluetooth objects wiiuse_os_find creates
+	WIIUSE_WARNING("Connecting by address is not supported on Mac OS X, use wiiuse_find().");
+	return 0;
+}
+
 void wiiuse_os_disconnect(struct wiimote_t* wm) {
 	if (!wm || !WIIMOTE_IS_CONNECTED(wm) || !wm->objc_wm)
 		return;
@@ -138,11 +144,13 @@ void wiiuse_os_disconnect(struct wiimote_t* wm) {
 #pragma mark -
 #pragma mark poll, read, write
 
-int wiiuse_os_poll(struct wiimote_t** wm, int wiimotes) {
+int wiiuse_os_poll(struct wiimote_t** wm, int wiimotes, int timeout_ms) {
 	int i;
 	byte read_buffer[MAX_PAYLOAD];
 	int evnt = 0;
 	
+	(void)timeout_ms; /* unused */
+	
 	if (!wm) return 0;
 	
 	for (i = 0; i < wiimotes; ++i) {
@@ -166,6 +174,11 @@ int wiiuse_os_poll(struct wiimote_t** wm, int wiimotes) {
 	return evnt;
 }
 
+int wiiuse_os_wait(struct wiimote_t* wm, int timeout_ms) {
+	(void)timeout_ms; /* wiiuse_os_read waits for the data itself */
+	return WIIMOTE_IS_CONNECTED(wm) ? 1 : -1;
+}
+
 int wiiuse_os_read(struct wiimote_t* wm, byte* buf, int len) {
 	if(!wm || !wm->objc_wm) return 0;
 	if(!WIIMOTE_IS_CONNECTED(wm)) {
@@ -44,15 +44,30 @@
 #include <bluetooth/l2cap.h>     /* for sockaddr_l2 */
 
 #include <errno.h>
+#include <poll.h> /* for poll */
 #include <stdbool.h>
 #include <stdio.h>      /* for perror */
 #include <string.h>     /* for memset */
-#include <sys/socket.h> /* for connect, socket */
-#include <sys/time.h>   /* for struct timeval */
+#include <sys/epoll.h>  /* for epoll_create1, epoll_ctl, epoll_wait */
+#include <sys/socket.h> /* for connect, socket, recv */
 #include <time.h>       /* for clock_gettime */
 #include <unistd.h>     /* for close, write */
 
+/* most ready wiimotes taken off the epoll set per poll, the rest wait for the next one */
+#define WIIUSE_POLL_EVENTS 32
+/* most reports read off one wiimote per poll, so a busy one can't starve the others */
+#define WIIUSE_POLL_BATCH 16
+
+/*
+ *	The input socket of every connected wiimote, added on connect and
+ *	removed on disconnect. It is edge triggered, so a wiimote is only
+ *	looked at once a report arrives, and is then read until it is empty.
+ */
+static int epoll_fd      = -1;
+static int epoll_members = 0;
+
 static int wiiuse_os_connect_single(struct wiimote_t *wm, char *address);
+static int wiiuse_os_recv(struct wiimote_t *wm, byte *buf, int len, int flags);
 
 int wiiuse_os_find(struct wiimote_t **wm, int max_wiimotes, int timeout)
 {
@@ -172,6 +187,63 @@ int wiiuse_os_connect(struct wiimote_t **wm, int wiimotes)
     return connected;
 }
 
+/**
+ *	@brief Add a connected wiimote's input socket to the epoll set.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *
+ *	@return 1 on success, 0 on failure
+ */
+static int wiiuse_os_watch(struct wiimote_t *wm)
+{
+    struct epoll_event ev;
+
+    if (epoll_fd == -1)
+    {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd == -1)
+        {
+            perror("epoll_create1()");
+            return 0;
+        }
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN | EPOLLET;
+    ev.data.ptr = wm;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wm->in_sock, &ev) == -1)
+    {
+        perror("epoll_ctl() interrupt sock");
+        return 0;
+    }
+    ++epoll_members;
+
+    /* anything that arrived before the socket was added has no edge to wake the poll */
+    wm->readable = 1;
+
+    return 1;
+}
+
+/**
+ *	@brief Remove a wiimote's input socket from the epoll set.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ */
+static void wiiuse_os_unwatch(struct wiimote_t *wm)
+{
+    if (epoll_fd == -1 || wm->in_sock == -1)
+    {
+        return;
+    }
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, wm->in_sock, NULL) == 0 && --epoll_members == 0)
+    {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    wm->readable = 0;
+}
+
 /**
  *	@brief Connect to a wiimote with a known address.
  *
@@ -245,6 +317,15 @@ static int wiiuse_os_connect_single(struct wiimote_t *wm, char *address)
         return 0;
     }
 
+    if (!wiiuse_os_watch(wm))
+    {
+        close(wm->out_sock);
+        close(wm->in_sock);
+        wm->out_sock = -1;
+        wm->in_sock  = -1;
+        return 0;
+    }
+
     WIIUSE_INFO("Connected to wiimote [id %i].", wm->unid);
 
     /* do the handshake */
@@ -256,6 +337,35 @@ static int wiiuse_os_connect_single(struct wiimote_t *wm, char *address)
     return 1;
 }
 
+/**
+ *	@see wiiuse_connect_address()
+ *	@see wiiuse_os_connect_single()
+ */
+int wiiuse_os_connect_address(struct wiimote_t *wm, const char *address)
+{
+    if (!wm || !address || WIIMOTE_IS_CONNECTED(wm))
+    {
+        return 0;
+    }
+
+    if (str2ba(address, &wm->bdaddr) < 0)
+    {
+        WIIUSE_ERROR("Invalid bluetooth address %s.", address);
+        return 0;
+    }
+    ba2str(&wm->bdaddr, wm->bdaddr_str);
+    WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_DEV_FOUND);
+
+    if (!wiiuse_os_connect_single(wm, NULL))
+    {
+        /* not in range, leave it for wiiuse_os_find() */
+        WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_DEV_FOUND);
+        return 0;
+    }
+
+    return 1;
+}
+
 void wiiuse_os_disconnect(struct wiimote_t *wm)
 {
     if (!wm || WIIMOTE_IS_CONNECTED(wm))
@@ -263,6 +373,7 @@ void wiiuse_os_disconnect(struct wiimote_t *wm)
         return;
     }
 
+    wiiuse_os_unwatch(wm);
     close(wm->out_sock);
     close(wm->in_sock);
 
@@ -274,15 +385,15 @@ void wiiuse_os_disconnect(struct wiimote_t *wm)
     WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_HANDSHAKE);
 }
 
-int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes)
+int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes, int timeout_ms)
 {
     int evnt;
-    struct timeval tv;
-    fd_set fds;
+    struct epoll_event events[WIIUSE_POLL_EVENTS];
+    int ready;
     int r;
     int i;
+    int n;
     byte read_buffer[MAX_PAYLOAD];
-    int highest_fd = -1;
 
     evnt = 0;
     if (!wm)
@@ -290,41 +401,34 @@ int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes)
         return 0;
     }
 
-    /* block select() for 1/2000th of a second */
-    tv.tv_sec  = 0;
-    tv.tv_usec = 500;
-
-    FD_ZERO(&fds);
-
     for (i = 0; i < wiimotes; ++i)
     {
-        /* only poll it if it is connected */
-        if (WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_CONNECTED))
+        /* a wiimote the last poll left reports on is read without waiting */
+        if (WIIMOTE_IS_CONNECTED(wm[i]) && wm[i]->readable)
         {
-            FD_SET(wm[i]->in_sock, &fds);
-
-            /* find the highest fd of the connected wiimotes */
-            if (wm[i]->in_sock > highest_fd)
-            {
-                highest_fd = wm[i]->in_sock;
-            }
+            timeout_ms = 0;
         }
 
         wm[i]->event = WIIUSE_NONE;
     }
 
-    if (highest_fd == -1)
+    if (epoll_fd == -1)
     /* nothing to poll */
     {
         return 0;
     }
 
-    if (select(highest_fd + 1, &fds, NULL, NULL, &tv) == -1)
+    ready = epoll_wait(epoll_fd, events, WIIUSE_POLL_EVENTS, timeout_ms);
+    if (ready == -1 && errno != EINTR)
     {
-        WIIUSE_ERROR("Unable to select() the wiimote interrupt socket(s).");
+        WIIUSE_ERROR("Unable to epoll_wait() on the wiimote interrupt socket(s).");
         perror("Error Details");
         return 0;
     }
+    for (n = 0; n < ready; ++n)
+    {
+        ((struct wiimote_t *)events[n].data.ptr)->readable = 1;
+    }
 
     /* check each socket for an event */
     for (i = 0; i < wiimotes; ++i)
@@ -335,49 +439,99 @@ int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes)
             continue;
         }
 
-        if (FD_ISSET(wm[i]->in_sock, &fds))
+        if (!wm[i]->readable)
+        {
+            /* send out any waiting writes */
+            wiiuse_send_next_pending_write_request(wm[i]);
+            idle_cycle(wm[i]);
+            continue;
+        }
+
+        /* clear out any old read data */
+        clear_dirty_reads(wm[i]);
+
+        /* read until the socket is empty, or a report leaves an event the caller has to see */
+        for (n = 0; n < WIIUSE_POLL_BATCH && wm[i]->event == WIIUSE_NONE; ++n)
         {
             /* clear out the event buffer */
             memset(read_buffer, 0, sizeof(read_buffer));
 
-            /* clear out any old read data */
-            clear_dirty_reads(wm[i]);
-
-            /* read the pending message into the buffer */
-            r = wiiuse_os_read(wm[i], read_buffer, sizeof(read_buffer));
+            r = wiiuse_os_recv(wm[i], read_buffer, sizeof(read_buffer), MSG_DONTWAIT);
             if (r > 0)
             {
                 /* propagate the event */
                 propagate_event(wm[i], read_buffer[0], read_buffer + 1);
-                evnt += (wm[i]->event != WIIUSE_NONE);
-            } else if (!WIIMOTE_IS_CONNECTED(wm[i]))
+                continue;
+            }
+
+            wm[i]->readable = 0;
+            if (!WIIMOTE_IS_CONNECTED(wm[i]))
             {
                 /* freshly disconnected */
                 wm[i]->event = (r == 0) ? WIIUSE_DISCONNECT : WIIUSE_UNEXPECTED_DISCONNECT;
-                evnt++;
                 /* propagate the event:
                    Emit a controller-status type event. */
                 propagate_event(wm[i], WM_RPT_CTRL_STATUS, 0);
             }
-        } else
-        {
-            /* send out any waiting writes */
-            wiiuse_send_next_pending_write_request(wm[i]);
-            idle_cycle(wm[i]);
+            break;
         }
+
+        evnt += (wm[i]->event != WIIUSE_NONE);
     }
 
     return evnt;
 }
 
-int wiiuse_os_read(struct wiimote_t *wm, byte *buf, int len)
+int wiiuse_os_wait(struct wiimote_t *wm, int timeout_ms)
 {
+    struct pollfd fd;
     int rc;
 
-    rc = read(wm->in_sock, buf, len);
+    fd.fd      = wm->in_sock;
+    fd.events  = POLLIN;
+    fd.revents = 0;
 
+    rc = poll(&fd, 1, timeout_ms);
     if (rc == -1)
     {
+        /* a signal cuts the wait short, the caller works out how long is left */
+        if (errno == EINTR)
+        {
+            return 0;
+        }
+        WIIUSE_ERROR("Unable to poll() the wiimote interrupt socket (id %i).", wm->unid);
+        perror("Error Details");
+        return -1;
+    }
+
+    /* a hang up is read as well, so it is noticed */
+    return rc > 0;
+}
+
+/**
+ *	@brief Read one report off a wiimote's input socket.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param buf		Buffer the report is stored in, buf[0] being the report type.
+ *	@param len		Length of the buffer.
+ *	@param flags	Flags passed on to recv(), MSG_DONTWAIT returns -1 once the socket is empty.
+ *
+ *	@return The length read, 0 if the wiimote hung up, or -1.
+ */
+static int wiiuse_os_recv(struct wiimote_t *wm, byte *buf, int len, int flags)
+{
+    int rc;
+
+    rc = recv(wm->in_sock, buf, len, flags);
+
+    if (rc == -1)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            /* nothing left to read */
+            return rc;
+        }
+
         /* error reading data */
         WIIUSE_ERROR("Receiving wiimote data (id %i).", wm->unid);
         perror("Error Details");
@@ -418,6 +572,8 @@ int wiiuse_os_read(struct wiimote_t *wm, byte *buf, int len)
     return rc;
 }
 
+int wiiuse_os_read(struct wiimote_t *wm, byte *buf, int len) { return wiiuse_os_recv(wm, buf, len, 0); }
+
 int wiiuse_os_write(struct wiimote_t *wm, byte report_type, byte *buf, int len)
 {
     int rc;
@@ -442,20 +598,23 @@ void wiiuse_init_platform_fields(struct wiimote_t *wm)
     memset(&(wm->bdaddr), 0, sizeof(bdaddr_t)); /* = *BDADDR_ANY;*/
     wm->out_sock = -1;
     wm->in_sock  = -1;
+    wm->readable = 0;
 }
 
 void wiiuse_cleanup_platform_fields(struct wiimote_t *wm)
 {
+    /* the wiimote is about to be freed, it can't be left in the epoll set */
+    wiiuse_os_unwatch(wm);
     wm->out_sock = -1;
     wm->in_sock  = -1;
 }
 
-unsigned long wiiuse_os_ticks()
+uint64_t wiiuse_os_ticks_us()
 {
     struct timespec tp;
-    clock_gettime(CLOCK_REALTIME, &tp);
-    unsigned long ms = 1000 * tp.tv_sec + tp.tv_nsec / 1e6;
-    return ms;
+    /* monotonic, so setting the clock can't cut a timeout short or stretch it */
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (uint64_t)tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
 }
 
 #endif /* ifdef WIIUSE_BLUEZ */
@@ -0,0 +1,770 @@
+/*
+ *	wiiuse
+ *
+ *	Written By:
+ *		Michael Laforest	< para >
+ *		Email: < thepara (--AT--) g m a i l [--DOT--] com >
+ *
+ *	Copyright 2006-2007
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Handles device I/O against simulated wiimotes.
+ *
+ *	Every simulated wiimote is a thread holding an EEPROM image, talking
+ *	to the library over a socketpair in place of the L2CAP channel. The
+ *	thread answers status requests, memory reads and memory writes the
+ *	way a real wiimote does, after a configurable latency, and can be
+ *	told to lose replies or slip button reports in between them.
+ */
+
+#include "wiiuse_internal.h" /* for WM_RPT_CTRL_STATUS */
+#include "events.h"
+#include "io.h"
+#include "os.h"
+
+#ifdef WIIUSE_SIM
+
+#include <errno.h>
+#include <poll.h>       /* for poll */
+#include <pthread.h>    /* for pthread_create, pthread_join */
+#include <stdio.h>      /* for perror, fopen */
+#include <stdlib.h>     /* for getenv, strtoul */
+#include <string.h>     /* for memset */
+#include <sys/socket.h> /* for socketpair */
+#include <time.h>       /* for clock_gettime */
+#include <unistd.h>     /* for close, read, write */
+
+#define SIM_MAX_REMOTES 8
+#define SIM_EEPROM_SIZE 0x1700 /* user memory ends at 0x16FF */
+#define SIM_REPORT_SIZE 23     /* 0xA1, report type, 21 bytes of payload */
+#define SIM_QUEUE_SIZE  2048   /* replies waiting for their latency to pass */
+
+/** @brief A report on its way to the library. */
+struct sim_report_t
+{
+    unsigned long long due; /**< when it arrives, in microseconds */
+    int len;
+    byte data[SIM_REPORT_SIZE];
+};
+
+/** @brief One simulated wiimote. */
+struct sim_remote_t
+{
+    int index;
+    char address[18];
+    byte eeprom[SIM_EEPROM_SIZE];
+    int loaded; /**< the eeprom has been filled in */
+    byte leds;
+
+    int sock; /**< the wiimote end of the socketpair */
+    pthread_t thread;
+    int running;
+    unsigned int rng;
+
+    struct sim_report_t queue[SIM_QUEUE_SIZE];
+    int head;
+    int count;
+    unsigned long long last_due;
+};
+
+static struct wiiuse_sim_config_t sim_config;
+static int sim_configured = 0;
+static struct sim_remote_t sim_remotes[SIM_MAX_REMOTES];
+
+static unsigned long long sim_now_us()
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (unsigned long long)tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
+}
+
+static unsigned long sim_env(const char *name, unsigned long fallback)
+{
+    const char *value = getenv(name);
+    return value ? strtoul(value, NULL, 0) : fallback;
+}
+
+/**
+ *	@brief Fill in the configuration from the environment, unless wiiuse_sim_configure() was called.
+ */
+static void sim_load_config()
+{
+    if (sim_configured)
+    {
+        return;
+    }
+
+    sim_config.remotes             = (int)sim_env("WIIUSE_SIM_REMOTES", 2);
+    sim_config.latency_us          = sim_env("WIIUSE_SIM_LATENCY_US", 0);
+    sim_config.jitter_us           = sim_env("WIIUSE_SIM_JITTER_US", 0);
+    sim_config.report_us           = sim_env("WIIUSE_SIM_REPORT_US", 0);
+    sim_config.drop_permille       = sim_env("WIIUSE_SIM_DROP_PERMILLE", 0);
+    sim_config.interleave_permille = sim_env("WIIUSE_SIM_INTERLEAVE_PERMILLE", 0);
+    sim_config.eeprom_dir          = getenv("WIIUSE_SIM_EEPROM_DIR");
+    sim_config.seed                = (unsigned int)sim_env("WIIUSE_SIM_SEED", 1);
+    sim_configured                 = 1;
+}
+
+void wiiuse_sim_configure(const struct wiiuse_sim_config_t *config)
+{
+    sim_config     = *config;
+    sim_configured = 1;
+}
+
+static unsigned int sim_random(struct sim_remote_t *sim)
+{
+    /* xorshift, so runs with the same seed behave the same */
+    sim->rng ^= sim->rng << 13;
+    sim->rng ^= sim->rng >> 17;
+    sim->rng ^= sim->rng << 5;
+    return sim->rng;
+}
+
+static void sim_eeprom_path(struct sim_remote_t *sim, char *path, size_t len)
+{
+    snprintf(path, len, "%s/sim-remote-%d.eeprom", sim_config.eeprom_dir, sim->index);
+}
+
+static void sim_load_eeprom(struct sim_remote_t *sim)
+{
+    char path[512];
+    FILE *fp;
+
+    if (sim->loaded)
+    {
+        return;
+    }
+    sim->loaded = 1;
+
+    memset(sim->eeprom, 0, sizeof(sim->eeprom));
+    /* accelerometer calibration, read during the handshake */
+    sim->eeprom[0x16] = 0x80;
+    sim->eeprom[0x17] = 0x80;
+    sim->eeprom[0x18] = 0x80;
+    sim->eeprom[0x1a] = 0x9a;
+    sim->eeprom[0x1b] = 0x9a;
+    sim->eeprom[0x1c] = 0x9a;
+
+    if (!sim_config.eeprom_dir)
+    {
+        return;
+    }
+    sim_eeprom_path(sim, path, sizeof(path));
+    fp = fopen(path, "rb");
+    if (fp)
+    {
+        if (fread(sim->eeprom, 1, sizeof(sim->eeprom), fp) != sizeof(sim->eeprom))
+        {
+            WIIUSE_WARNING("Simulated wiimote eeprom %s is short.", path);
+        }
+        fclose(fp);
+    }
+}
+
+static void sim_save_eeprom(struct sim_remote_t *sim)
+{
+    char path[512];
+    FILE *fp;
+
+    if (!sim_config.eeprom_dir)
+    {
+        return;
+    }
+    sim_eeprom_path(sim, path, sizeof(path));
+    fp = fopen(path, "wb");
+    if (!fp)
+    {
+        WIIUSE_ERROR("Unable to save simulated wiimote eeprom %s.", path);
+        return;
+    }
+    fwrite(sim->eeprom, 1, sizeof(sim->eeprom), fp);
+    fclose(fp);
+}
+
+/**
+ *	@brief Queue a report for the library, after the configured latency.
+ *
+ *	Reports keep their order, like they do over L2CAP, so one is never
+ *	due before the one queued ahead of it.
+ */
+static void sim_queue_report(struct sim_remote_t *sim, byte report, const byte *payload, int len)
+{
+    struct sim_report_t *rpt;
+    unsigned long long due = sim_now_us() + sim_config.latency_us;
+
+    /* a reply that got lost on the way */
+    if (sim_config.drop_permille && sim_random(sim) % 1000 < sim_config.drop_permille)
+    {
+        return;
+    }
+    if (sim->count == SIM_QUEUE_SIZE)
+    {
+        WIIUSE_WARNING("Simulated wiimote %d queue is full, dropping report 0x%x.", sim->index, report);
+        return;
+    }
+
+    if (sim_config.jitter_us)
+    {
+        due += sim_random(sim) % (sim_config.jitter_us + 1);
+    }
+    if (sim->count && due < sim->last_due + sim_config.report_us)
+    {
+        due = sim->last_due + sim_config.report_us;
+    }
+    sim->last_due = due;
+
+    rpt          = &sim->queue[(sim->head + sim->count++) % SIM_QUEUE_SIZE];
+    rpt->due     = due;
+    rpt->len     = len + 2;
+    rpt->data[0] = WM_SET_DATA | WM_BT_INPUT;
+    rpt->data[1] = report;
+    memcpy(rpt->data + 2, payload, len);
+}
+
+static void sim_reply(struct sim_remote_t *sim, byte report, const byte *payload, int len)
+{
+    static const byte buttons[2] = {0x00, 0x00};
+
+    /* a button report from a remote left in continuous reporting */
+    if (sim_config.interleave_permille && sim_random(sim) % 1000 < sim_config.interleave_permille)
+    {
+        sim_queue_report(sim, WM_RPT_BTN, buttons, sizeof(buttons));
+    }
+    sim_queue_report(sim, report, payload, len);
+}
+
+static void sim_read(struct sim_remote_t *sim, const byte *msg)
+{
+    byte rpt[21];
+    int registers = msg[0] & 0x04;
+    unsigned addr = (msg[1] << 16) | (msg[2] << 8) | msg[3];
+    unsigned size = (msg[4] << 8) | msg[5];
+    unsigned offset;
+
+    if (!registers && addr + size > SIM_EEPROM_SIZE)
+    {
+        /* address does not exist */
+        memset(rpt, 0, sizeof(rpt));
+        rpt[2] = 0xf8;
+        rpt[3] = (addr >> 8) & 0xff;
+        rpt[4] = addr & 0xff;
+        sim_reply(sim, WM_RPT_READ, rpt, sizeof(rpt));
+        return;
+    }
+
+    for (offset = 0; offset < size; offset += 16)
+    {
+        unsigned len = (size - offset > 16) ? 16 : size - offset;
+        unsigned at  = addr + offset;
+
+        memset(rpt, 0, sizeof(rpt));
+        rpt[2] = (byte)((len - 1) << 4);
+        rpt[3] = (at >> 8) & 0xff;
+        rpt[4] = at & 0xff;
+        /* the registers of an expansion that isn't there read as zeros */
+        if (!registers)
+        {
+            memcpy(rpt + 5, sim->eeprom + at, len);
+        }
+        sim_reply(sim, WM_RPT_READ, rpt, sizeof(rpt));
+    }
+}
+
+static void sim_write(struct sim_remote_t *sim, const byte *msg)
+{
+    byte ack[4]   = {0x00, 0x00, WM_CMD_WRITE_DATA, 0x00};
+    int registers = msg[0] & 0x04;
+    unsigned addr = (msg[1] << 16) | (msg[2] << 8) | msg[3];
+    unsigned len  = msg[4];
+
+    if (len > 16 || (!registers && addr + len > SIM_EEPROM_SIZE))
+    {
+        ack[3] = 0x08;
+    } else if (!registers)
+    {
+        memcpy(sim->eeprom + addr, msg + 5, len);
+    }
+    sim_reply(sim, WM_RPT_WRITE, ack, sizeof(ack));
+}
+
+static void sim_handle(struct sim_remote_t *sim, const byte *buf, int len)
+{
+    byte status[6] = {0x00, 0x00, 0x00, 0x00, 0x00, 0xc8};
+
+    /* buf[0] is the transaction header, buf[1] the output report */
+    if (len < 3)
+    {
+        return;
+    }
+    switch (buf[1])
+    {
+    case WM_CMD_LED:
+        sim->leds = buf[2] & 0xf0;
+        break;
+    case WM_CMD_CTRL_STATUS:
+        status[2] = sim->leds;
+        sim_reply(sim, WM_RPT_CTRL_STATUS, status, sizeof(status));
+        break;
+    case WM_CMD_READ_DATA:
+        if (len >= 8)
+        {
+            sim_read(sim, buf + 2);
+        }
+        break;
+    case WM_CMD_WRITE_DATA:
+        if (len >= 7)
+        {
+            sim_write(sim, buf + 2);
+        }
+        break;
+    default:
+        /* report types, rumble and ir are accepted silently */
+        break;
+    }
+}
+
+/**
+ *	@brief The simulated wiimote, answering output reports until the library hangs up.
+ */
+static void *sim_run(void *arg)
+{
+    struct sim_remote_t *sim = (struct sim_remote_t *)arg;
+    byte buf[MAX_PAYLOAD];
+
+    sim_load_eeprom(sim);
+
+    for (;;)
+    {
+        struct pollfd pfd;
+        int timeout = -1;
+
+        /* send whatever is due */
+        while (sim->count)
+        {
+            struct sim_report_t *rpt = &sim->queue[sim->head];
+            unsigned long long now   = sim_now_us();
+            if (rpt->due > now)
+            {
+                timeout = (int)((rpt->due - now + 999) / 1000);
+                break;
+            }
+            if (send(sim->sock, rpt->data, rpt->len, MSG_DONTWAIT) < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    goto hangup;
+                }
+                /* the library is behind, try again in a bit */
+                timeout = 1;
+                break;
+            }
+            sim->head = (sim->head + 1) % SIM_QUEUE_SIZE;
+            sim->count--;
+        }
+
+        pfd.fd      = sim->sock;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+        {
+            break;
+        }
+        if (pfd.revents & (POLLIN | POLLHUP))
+        {
+            int r = (int)recv(sim->sock, buf, sizeof(buf), 0);
+            if (r <= 0)
+            {
+                break;
+            }
+            sim_handle(sim, buf, r);
+        }
+    }
+
+hangup:
+    sim_save_eeprom(sim);
+    close(sim->sock);
+    sim->count = 0;
+    return NULL;
+}
+
+static void sim_address(int index, char *address)
+{
+    snprintf(address, 18, "00:1F:32:00:00:%02X", index + 1);
+}
+
+int wiiuse_os_find(struct wiimote_t **wm, int max_wiimotes, int timeout)
+{
+    int found_wiimotes = 0;
+    int i;
+    (void)timeout; /* the simulated remotes answer straight away */
+
+    sim_load_config();
+    for (i = 0; i < sim_config.remotes && i < SIM_MAX_REMOTES && found_wiimotes < max_wiimotes; ++i)
+    {
+        char address[18];
+        int j;
+
+        /* remotes that are already connected don't answer an inquiry */
+        sim_address(i, address);
+        if (sim_remotes[i].running)
+        {
+            continue;
+        }
+        for (j = 0; j < found_wiimotes; ++j)
+        {
+            if (!strcmp(wm[j]->bdaddr_str, address))
+            {
+                break;
+            }
+        }
+        if (j < found_wiimotes)
+        {
+            continue;
+        }
+
+        strcpy(wm[found_wiimotes]->bdaddr_str, address);
+        wm[found_wiimotes]->type = WIIUSE_WIIMOTE_REGULAR;
+        WIIUSE_INFO("Found wiimote (type: (simulated)) (%s) [id %i].", address, wm[found_wiimotes]->unid);
+        WIIMOTE_ENABLE_STATE(wm[found_wiimotes], WIIMOTE_STATE_DEV_FOUND);
+        ++found_wiimotes;
+    }
+
+    return found_wiimotes;
+}
+
+/**
+ *	@brief Connect to the simulated wiimote with the address in bdaddr_str.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *
+ *	@return 1 on success, 0 on failure
+ */
+static int wiiuse_os_connect_single(struct wiimote_t *wm)
+{
+    struct sim_remote_t *sim;
+    int socks[2];
+    int i;
+
+    if (!wm || WIIMOTE_IS_CONNECTED(wm))
+    {
+        return 0;
+    }
+
+    sim_load_config();
+    for (i = 0; i < sim_config.remotes && i < SIM_MAX_REMOTES; ++i)
+    {
+        char address[18];
+        sim_address(i, address);
+        if (!strcmp(address, wm->bdaddr_str))
+        {
+            break;
+        }
+    }
+    if (i == sim_config.remotes || i == SIM_MAX_REMOTES || sim_remotes[i].running)
+    {
+        return 0;
+    }
+    sim = &sim_remotes[i];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, socks) < 0)
+    {
+        perror("socketpair()");
+        return 0;
+    }
+
+    sim->index = i;
+    sim_address(i, sim->address);
+    sim->sock     = socks[1];
+    sim->head     = 0;
+    sim->count    = 0;
+    sim->last_due = 0;
+    sim->rng      = sim_config.seed * 2654435761u + i + 1;
+    if (pthread_create(&sim->thread, NULL, sim_run, sim))
+    {
+        close(socks[0]);
+        close(socks[1]);
+        return 0;
+    }
+    sim->running = 1;
+    wm->in_sock  = socks[0];
+    wm->sim      = sim;
+
+    WIIUSE_INFO("Connected to wiimote [id %i].", wm->unid);
+
+    /* do the handshake */
+    WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_CONNECTED);
+    wiiuse_handshake(wm, NULL, 0);
+
+    wiiuse_set_report_type(wm);
+
+    return 1;
+}
+
+/**
+ *	@see wiiuse_connect()
+ *	@see wiiuse_os_connect_single()
+ */
+int wiiuse_os_connect(struct wiimote_t **wm, int wiimotes)
+{
+    int connected = 0;
+    int i         = 0;
+
+    for (; i < wiimotes; ++i)
+    {
+        if (!WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_FOUND))
+        /* if the device address is not set, skip it */
+        {
+            continue;
+        }
+
+        if (wiiuse_os_connect_single(wm[i]))
+        {
+            ++connected;
+        }
+    }
+
+    return connected;
+}
+
+/**
+ *	@see wiiuse_connect_address()
+ *	@see wiiuse_os_connect_single()
+ */
+int wiiuse_os_connect_address(struct wiimote_t *wm, const char *address)
+{
+    if (!wm || !address || WIIMOTE_IS_CONNECTED(wm))
+    {
+        return 0;
+    }
+
+    snprintf(wm->bdaddr_str, sizeof(wm->bdaddr_str), "%s", address);
+    WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_DEV_FOUND);
+
+    if (!wiiuse_os_connect_single(wm))
+    {
+        /* not in range, leave it for wiiuse_os_find() */
+        WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_DEV_FOUND);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ *	@brief Hang up on the simulated wiimote and wait for it to save its eeprom.
+ */
+static void sim_hangup(struct wiimote_t *wm)
+{
+    if (wm->in_sock != -1)
+    {
+        close(wm->in_sock);
+        wm->in_sock = -1;
+    }
+    if (wm->sim && wm->sim->running)
+    {
+        pthread_join(wm->sim->thread, NULL);
+        wm->sim->running = 0;
+    }
+    wm->sim = NULL;
+}
+
+void wiiuse_os_disconnect(struct wiimote_t *wm)
+{
+    if (!wm || !WIIMOTE_IS_CONNECTED(wm))
+    {
+        return;
+    }
+
+    sim_hangup(wm);
+    wm->event = WIIUSE_NONE;
+
+    WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_CONNECTED);
+    WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_HANDSHAKE);
+}
+
+int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes, int timeout_ms)
+{
+    int evnt;
+    struct pollfd fds[SIM_MAX_REMOTES];
+    int polled = 0;
+    int r;
+    int i;
+    byte read_buffer[MAX_PAYLOAD];
+
+    evnt = 0;
+    if (!wm)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        /* only poll it if it is connected */
+        if (WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_CONNECTED) && polled < SIM_MAX_REMOTES)
+        {
+            fds[polled].fd      = wm[i]->in_sock;
+            fds[polled].events  = POLLIN;
+            fds[polled].revents = 0;
+            polled++;
+        }
+
+        wm[i]->event = WIIUSE_NONE;
+    }
+
+    if (!polled)
+    /* nothing to poll */
+    {
+        return 0;
+    }
+
+    if (poll(fds, polled, timeout_ms) == -1 && errno != EINTR)
+    {
+        WIIUSE_ERROR("Unable to poll() the simulated wiimote socket(s).");
+        perror("Error Details");
+        return 0;
+    }
+
+    /* check each socket for an event */
+    for (i = 0, polled = 0; i < wiimotes; ++i)
+    {
+        /* if this wiimote is not connected, skip it */
+        if (!WIIMOTE_IS_CONNECTED(wm[i]) || polled == SIM_MAX_REMOTES)
+        {
+            continue;
+        }
+
+        if (fds[polled++].revents & (POLLIN | POLLHUP))
+        {
+            /* clear out the event buffer */
+            memset(read_buffer, 0, sizeof(read_buffer));
+
+            /* clear out any old read data */
+            clear_dirty_reads(wm[i]);
+
+            /* read the pending message into the buffer */
+            r = wiiuse_os_read(wm[i], read_buffer, sizeof(read_buffer));
+            if (r > 0)
+            {
+                /* propagate the event */
+                propagate_event(wm[i], read_buffer[0], read_buffer + 1);
+                evnt += (wm[i]->event != WIIUSE_NONE);
+            } else if (!WIIMOTE_IS_CONNECTED(wm[i]))
+            {
+                /* freshly disconnected */
+                wm[i]->event = (r == 0) ? WIIUSE_DISCONNECT : WIIUSE_UNEXPECTED_DISCONNECT;
+                evnt++;
+                /* propagate the event:
+                   Emit a controller-status type event. */
+                propagate_event(wm[i], WM_RPT_CTRL_STATUS, 0);
+            }
+        } else
+        {
+            /* send out any waiting writes */
+            wiiuse_send_next_pending_write_request(wm[i]);
+            idle_cycle(wm[i]);
+        }
+    }
+
+    return evnt;
+}
+
+int wiiuse_os_wait(struct wiimote_t *wm, int timeout_ms)
+{
+    struct pollfd fd;
+    int rc;
+
+    fd.fd      = wm->in_sock;
+    fd.events  = POLLIN;
+    fd.revents = 0;
+
+    rc = poll(&fd, 1, timeout_ms);
+    if (rc == -1)
+    {
+        if (errno == EINTR)
+        {
+            return 0;
+        }
+        WIIUSE_ERROR("Unable to poll() the simulated wiimote socket (id %i).", wm->unid);
+        perror("Error Details");
+        return -1;
+    }
+
+    return rc > 0;
+}
+
+int wiiuse_os_read(struct wiimote_t *wm, byte *buf, int len)
+{
+    int rc;
+
+    rc = read(wm->in_sock, buf, len);
+
+    if (rc == -1)
+    {
+        /* error reading data */
+        WIIUSE_ERROR("Receiving wiimote data (id %i).", wm->unid);
+        perror("Error Details");
+    } else if (rc == 0)
+    {
+        /* remote disconnect */
+        wiiuse_disconnected(wm);
+    } else
+    {
+        /* read successful */
+        /* like on *nix we ignore the first byte */
+        memmove(buf, buf + 1, len - 1);
+    }
+
+    return rc;
+}
+
+int wiiuse_os_write(struct wiimote_t *wm, byte report_type, byte *buf, int len)
+{
+    int rc;
+    byte write_buffer[MAX_PAYLOAD];
+
+    write_buffer[0] = WM_SET_DATA | WM_BT_OUTPUT;
+    write_buffer[1] = report_type;
+    memcpy(write_buffer + 2, buf, len);
+
+    rc = write(wm->in_sock, write_buffer, len + 2);
+
+    if (rc < 0)
+    {
+        wiiuse_disconnected(wm);
+    }
+
+    return rc;
+}
+
+void wiiuse_init_platform_fields(struct wiimote_t *wm)
+{
+    memset(wm->bdaddr_str, 0, sizeof(wm->bdaddr_str));
+    wm->in_sock = -1;
+    wm->sim     = NULL;
+}
+
+void wiiuse_cleanup_platform_fields(struct wiimote_t *wm) { sim_hangup(wm); }
+
+uint64_t wiiuse_os_ticks_us() { return sim_now_us(); }
+
+#endif /* ifdef WIIUSE_SIM */
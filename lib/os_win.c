@@ -43,21 +43,16 @@
 #include <hidsdi.h>
 #include <setupapi.h>
 
-unsigned long wiiuse_os_ticks()
+uint64_t wiiuse_os_ticks_us()
 {
-    FILETIME ft;
-    ULARGE_INTEGER hnsTime;
-
-#if _WIN32_WINNT >= _WIN32_WINNT_WIN10
-    GetSystemTimePreciseAsFileTime(&ft);
-#else
-    GetSystemTimeAsFileTime(&ft);
-#endif
-
-    hnsTime.LowPart = ft.dwLowDateTime;
-    hnsTime.HighPart = ft.dwHighDateTime;
-
-    return hnsTime.QuadPart / 10000ULL;
+    LARGE_INTEGER freq, count;
+
+    /* the performance counter never goes back, unlike the system time */
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    /* split into whole seconds first, so the count can't overflow on the way to microseconds */
+    return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000 +
+           (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
 }
 
 int wiiuse_os_find(struct wiimote_t **wm, int max_wiimotes, int timeout)
@@ -192,6 +187,13 @@ int wiiuse_os_connect(struct wiimote_t **wm, int wiimotes)
     return connected;
 }
 
+int wiiuse_os_connect_address(struct wiimote_t *wm, const char *address)
+{
+    /* devices are opened by HID path in wiiuse_os_find(), there is no address to connect to */
+    WIIUSE_WARNING("Connecting by address is not supported on Windows, use wiiuse_find().");
+    return 0;
+}
+
 void wiiuse_os_disconnect(struct wiimote_t *wm)
 {
     if (!wm || WIIMOTE_IS_CONNECTED(wm))
@@ -210,12 +212,14 @@ void wiiuse_os_disconnect(struct wiimote_t *wm)
     WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_HANDSHAKE);
 }
 
-int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes)
+int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes, int timeout_ms)
 {
     int i;
     byte read_buffer[MAX_PAYLOAD];
     int evnt = 0;
 
+    (void)timeout_ms; /* every wiimote is read with its own wm->timeout */
+
     if (!wm)
     {
         return 0;
@@ -244,6 +248,12 @@ int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes)
     return evnt;
 }
 
+int wiiuse_os_wait(struct wiimote_t *wm, int timeout_ms)
+{
+    (void)timeout_ms; /* wiiuse_os_read() waits on the overlapped read for wm->timeout itself */
+    return WIIMOTE_IS_CONNECTED(wm) ? 1 : -1;
+}
+
 int wiiuse_os_read(struct wiimote_t *wm, byte *buf, int len)
 {
     DWORD b, r;
@@ -51,6 +51,14 @@ static const char g_wiiuse_version_string[] = WIIUSE_VERSION;
  */
 const char *wiiuse_version() { return g_wiiuse_version_string; }
 
+/**
+ *	@brief Returns a monotonic time in microseconds.
+ *
+ *	Only the difference between two calls means anything.  It is the
+ *	clock the library times its own waits with.
+ */
+uint64_t wiiuse_ticks_us() { return wiiuse_os_ticks_us(); }
+
 /**
  *	@brief Output FILE stream for each wiiuse_loglevel.
  */
@@ -85,6 +93,13 @@ void wiiuse_cleanup(struct wiimote_t **wm, int wiimotes)
     {
         wiiuse_disconnect(wm[i]);
         wiiuse_cleanup_platform_fields(wm[i]);
+        free(wm[i]->rx_queue);
+        while (wm[i]->req_slabs)
+        {
+            void *next = *(void **)wm[i]->req_slabs;
+            free(wm[i]->req_slabs);
+            wm[i]->req_slabs = next;
+        }
         free(wm[i]);
     }
 
@@ -191,7 +206,28 @@ void wiiuse_disconnected(struct wiimote_t *wm)
     /* reset a bunch of stuff */
     wm->leds     = 0;
     wm->state    = WIIMOTE_INIT_STATES;
-    wm->read_req = NULL;
+    /* the requests in flight will never be answered */
+    while (wm->read_req)
+    {
+        struct read_req_t *req = wm->read_req;
+        wm->read_req           = req->next;
+        wiiuse_free_read_req(wm, req);
+    }
+    wm->read_req_tail = NULL;
+    while (wm->data_req)
+    {
+        struct data_req_t *req = wm->data_req;
+        wm->data_req           = req->next;
+        wiiuse_free_data_req(wm, req);
+    }
+    wm->data_req_tail = NULL;
+    wm->read_held = 0;
+    wm->rate_need = 0;
+    if (wm->rx_queue)
+    {
+        /* nothing held back from before is of any use */
+        wm->rx_queue->count = 0;
+    }
 #ifndef WIIUSE_SYNC_HANDSHAKE
     wm->handshake_state = 0;
 #endif
@@ -391,6 +427,117 @@ int wiiuse_set_report_type(struct wiimote_t *wm)
     return buf[1];
 }
 
+/**
+ *	@brief	Carve a slab of request nodes for a wiimote.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param size		The size of one request.
+ *
+ *	@return WIIUSE_REQ_SLAB uninitialized requests, or NULL if out of memory.
+ *
+ *	Slabs stay with the wiimote until wiiuse_cleanup(), the requests
+ *	carved from them go back and forth through its free lists.
+ */
+static void *wiiuse_alloc_req_slab(struct wiimote_t *wm, size_t size)
+{
+    void **slab = (void **)malloc(sizeof(void *) + WIIUSE_REQ_SLAB * size);
+
+    if (!slab)
+    {
+        return NULL;
+    }
+    *slab         = wm->req_slabs;
+    wm->req_slabs = slab;
+
+    return slab + 1;
+}
+
+/**
+ *	@brief	Take a read request from the wiimote's free list.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *
+ *	@return The request, or NULL if out of memory.
+ */
+struct read_req_t *wiiuse_alloc_read_req(struct wiimote_t *wm)
+{
+    struct read_req_t *req = wm->free_read_req;
+
+    if (!req)
+    {
+        int i;
+
+        req = (struct read_req_t *)wiiuse_alloc_req_slab(wm, sizeof(struct read_req_t));
+        if (!req)
+        {
+            return NULL;
+        }
+        for (i = 0; i < WIIUSE_REQ_SLAB - 1; ++i)
+        {
+            req[i].next = &req[i + 1];
+        }
+        req[i].next = NULL;
+    }
+    wm->free_read_req = req->next;
+
+    return req;
+}
+
+/**
+ *	@brief	Give a finished read request back to the wiimote's free list.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param req		The request, no longer in wm->read_req.
+ */
+void wiiuse_free_read_req(struct wiimote_t *wm, struct read_req_t *req)
+{
+    req->next         = wm->free_read_req;
+    wm->free_read_req = req;
+}
+
+/**
+ *	@brief	Take a write request from the wiimote's free list.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *
+ *	@return The request, or NULL if out of memory.
+ */
+struct data_req_t *wiiuse_alloc_data_req(struct wiimote_t *wm)
+{
+    struct data_req_t *req = wm->free_data_req;
+
+    if (!req)
+    {
+        int i;
+
+        req = (struct data_req_t *)wiiuse_alloc_req_slab(wm, sizeof(struct data_req_t));
+        if (!req)
+        {
+            return NULL;
+        }
+        for (i = 0; i < WIIUSE_REQ_SLAB - 1; ++i)
+        {
+            req[i].next = &req[i + 1];
+        }
+        req[i].next = NULL;
+    }
+    wm->free_data_req = req->next;
+
+    return req;
+}
+
+/**
+ *	@brief	Give a finished write request back to the wiimote's free list.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param req		The request, no longer in wm->data_req.
+ */
+void wiiuse_free_data_req(struct wiimote_t *wm, struct data_req_t *req)
+{
+    req->next         = wm->free_data_req;
+    wm->free_data_req = req;
+}
+
 /**
  *	@brief	Read data from the wiimote (callback version).
  *
@@ -423,7 +570,7 @@ int wiiuse_read_data_cb(struct wiimote_t *wm, wiiuse_read_cb read_cb, byte *buff
     }
 
     /* make this request structure */
-    req = (struct read_req_t *)malloc(sizeof(struct read_req_t));
+    req = wiiuse_alloc_read_req(wm);
     if (req == NULL)
     {
         return 0;
@@ -440,7 +587,8 @@ int wiiuse_read_data_cb(struct wiimote_t *wm, wiiuse_read_cb read_cb, byte *buff
     if (!wm->read_req)
     {
         /* root node */
-        wm->read_req = req;
+        wm->read_req      = req;
+        wm->read_req_tail = req;
 
         WIIUSE_DEBUG("Data read request can be sent out immediately.");
 
@@ -448,14 +596,19 @@ int wiiuse_read_data_cb(struct wiimote_t *wm, wiiuse_read_cb read_cb, byte *buff
         wiiuse_send_next_pending_read_request(wm);
     } else
     {
-        struct read_req_t *nptr = wm->read_req;
-        for (; nptr->next; nptr = nptr->next)
-        {
-            ;
-        }
-        nptr->next = req;
+        /* requests are answered in order, so if the last one is, every one is */
+        int idle = wm->read_req_tail->dirty;
+
+        wm->read_req_tail->next = req;
+        wm->read_req_tail       = req;
 
         WIIUSE_DEBUG("Added pending data read request.");
+
+        /* dirty requests are only waiting to be cleaned up, so nothing is in flight */
+        if (idle)
+        {
+            wiiuse_send_next_pending_read_request(wm);
+        }
     }
 
     return 1;
@@ -482,6 +635,54 @@ int wiiuse_read_data(struct wiimote_t *wm, byte *buffer, unsigned int addr, uint
     return wiiuse_read_data_cb(wm, NULL, buffer, addr, len);
 }
 
+/**
+ *	@brief Take the bytes a request carries out of the wiimote's rate limit.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param len		The bytes the request writes or asks for.
+ *
+ *	@return Returns 1 if the request can go out now, 0 if it has to wait.
+ *
+ *	A request bigger than the burst waits for a full bucket.
+ */
+static int wiiuse_take_tokens(struct wiimote_t *wm, unsigned int len)
+{
+    uint64_t now;
+    uint64_t full;
+    uint64_t cost;
+
+    if (!wm->rate_limit)
+    {
+        return 1;
+    }
+
+    /* the bucket is kept in millionths of a byte, so every microsecond adds rate_limit of them */
+    now  = wiiuse_os_ticks_us();
+    full = (uint64_t)wm->rate_burst * 1000000;
+    cost = (uint64_t)(len < wm->rate_burst ? len : wm->rate_burst) * 1000000;
+    if (now - wm->rate_refilled >= full / wm->rate_limit)
+    {
+        wm->rate_tokens = full;
+    } else
+    {
+        wm->rate_tokens += (now - wm->rate_refilled) * wm->rate_limit;
+        if (wm->rate_tokens > full)
+        {
+            wm->rate_tokens = full;
+        }
+    }
+    wm->rate_refilled = now;
+
+    if (wm->rate_tokens < cost)
+    {
+        wm->rate_need = len < wm->rate_burst ? len : wm->rate_burst;
+        return 0;
+    }
+    wm->rate_tokens -= cost;
+
+    return 1;
+}
+
 /**
  *	@brief Send the next pending data read request to the wiimote.
  *
@@ -522,6 +723,13 @@ void wiiuse_send_next_pending_read_request(struct wiimote_t *wm)
     /* the length is in big endian */
     to_big_endian_uint16_t(buf + 4, req->size);
 
+    /* wiiuse_send_held_requests() sends it once the rate limit allows */
+    if (!wiiuse_take_tokens(wm, req->size))
+    {
+        wm->read_held = 1;
+        return;
+    }
+
     WIIUSE_DEBUG("Request read at address: 0x%x  length: %i", req->addr, req->size);
     wiiuse_send(wm, WM_CMD_READ_DATA, buf, 6);
 }
@@ -630,6 +838,39 @@ int wiiuse_write_data(struct wiimote_t *wm, unsigned int addr, const byte *data,
     return 1;
 }
 
+/**
+ *	@brief	Add a write request to the end of the wiimote's pending list.
+ *
+ *	@param wm			Pointer to a wiimote_t structure.
+ *	@param req			The request, ready to be sent.
+ */
+static void wiiuse_queue_data_req(struct wiimote_t *wm, struct data_req_t *req)
+{
+    req->state = REQ_READY;
+    req->next  = NULL;
+    /* add this to the request list */
+    if (!wm->data_req)
+    {
+        /* root node */
+        wm->data_req      = req;
+        wm->data_req_tail = req;
+
+        WIIUSE_DEBUG("Data write request can be sent out immediately.");
+
+        /* send the request out immediately */
+        wiiuse_send_next_pending_write_request(wm);
+    } else
+    {
+        wm->data_req_tail->next = req;
+        wm->data_req_tail       = req;
+
+        WIIUSE_DEBUG("Added pending data write request.");
+
+        /* the ones ahead may be done and only waiting to be cleaned up, or leave room in the window */
+        wiiuse_send_next_pending_write_request(wm);
+    }
+}
+
 /**
  *	@brief	Write data to the wiimote (callback version).
  *
@@ -637,14 +878,11 @@ int wiiuse_write_data(struct wiimote_t *wm, unsigned int addr, const byte *data,
  *	@param addr			The address to write to.
  *	@param data			The data to be written to the memory location.
  *	@param len			The length of the block to be written.
- *	@param cb			Function pointer to call when the data arrives from the wiimote.
+ *	@param cb			Function pointer to call when the wiimote acknowledges the write.
  *
- *	The library can only handle one data read request at a time
- *	because it must keep track of the buffer and other
- *	events that are specific to that request.  So if a request
- *	has already been made, subsequent requests will be added
- *	to a pending list and be sent out when the previous
- *	finishes.
+ *	Requests are added to a pending list. Up to WIIUSE_WRITE_WINDOW of them
+ *	are sent out ahead of their acknowledgements, and the rest are sent as
+ *	the acknowledgements for the earlier ones arrive.
  */
 int wiiuse_write_data_cb(struct wiimote_t *wm, unsigned int addr, byte *data, byte len,
                          wiiuse_write_cb write_cb)
@@ -660,37 +898,135 @@ int wiiuse_write_data_cb(struct wiimote_t *wm, unsigned int addr, byte *data, by
         return 0;
     }
 
-    req      = (struct data_req_t *)malloc(sizeof(struct data_req_t));
+    req = wiiuse_alloc_data_req(wm);
+    if (!req)
+    {
+        return 0;
+    }
     req->cb  = write_cb;
     req->len = len;
     memcpy(req->data, data, req->len);
-    req->state = REQ_READY;
-    req->addr  = addr; /* BIG_ENDIAN_LONG(addr); */
-    req->next  = NULL;
-    /* add this to the request list */
-    if (!wm->data_req)
+    req->addr = addr; /* BIG_ENDIAN_LONG(addr); */
+    req->iov  = NULL;
+    wiiuse_queue_data_req(wm, req);
+
+    return 1;
+}
+
+/**
+ *	@brief	Write runs of data of any length to the wiimote.
+ *
+ *	@param wm			Pointer to a wiimote_t structure.
+ *	@param iov			The runs to write. The array and the data it points to must
+ *						stay in place until the write completes.
+ *	@param iovcnt		The number of runs.
+ *	@param status		One byte per report the runs are split into, see
+ *						WIIUSE_WRITE_BLOCKS(). Each is WIIUSE_WRITE_PENDING until its
+ *						report is acknowledged, then 0 or the wiimote's error code.
+ *	@param cb			Function pointer to call once every report is acknowledged,
+ *						or NULL to get a WIIUSE_WRITE_DATA event instead.
+ *	@param arg			Passed on to cb.
+ *
+ *	@return The number of reports the runs are split into, 0 on failure.
+ *
+ *	Each run is sent as 16 byte reports from its start. The write takes a
+ *	single request from the pending list, however many reports it is split
+ *	into, and its reports are paced the same way as wiiuse_write_data_cb():
+ *	up to WIIUSE_WRITE_WINDOW ahead of their acknowledgements, within the
+ *	rate limit. Requests queued after it are sent once its last report is.
+ */
+unsigned int wiiuse_write_data_v(struct wiimote_t *wm, const struct wiiuse_iovec_t *iov, int iovcnt,
+                                 byte *status, wiiuse_write_v_cb cb, void *arg)
+{
+    struct data_req_t *req;
+    unsigned int blocks = 0;
+    int i;
+
+    if (!wm || !WIIMOTE_IS_CONNECTED(wm))
     {
-        /* root node */
-        wm->data_req = req;
+        return 0;
+    }
+    if (!iov || iovcnt <= 0 || !status)
+    {
+        return 0;
+    }
+    for (i = 0; i < iovcnt; ++i)
+    {
+        if (iov[i].len && !iov[i].data)
+        {
+            return 0;
+        }
+        blocks += WIIUSE_WRITE_BLOCKS(iov[i].len);
+    }
+    if (!blocks)
+    {
+        return 0;
+    }
 
-        WIIUSE_DEBUG("Data write request can be sent out immediately.");
+    req = wiiuse_alloc_data_req(wm);
+    if (!req)
+    {
+        return 0;
+    }
+    req->cb         = NULL;
+    req->len        = 0;
+    req->iov        = iov;
+    req->iovcnt     = iovcnt;
+    req->iov_next   = 0;
+    req->iov_offset = 0;
+    req->blocks     = blocks;
+    req->sent       = 0;
+    req->acked      = 0;
+    req->status     = status;
+    req->write_v_cb = cb;
+    req->arg        = arg;
+    memset(status, WIIUSE_WRITE_PENDING, blocks);
+
+    WIIUSE_DEBUG("Writing %i runs as %u reports...", iovcnt, blocks);
+    wiiuse_queue_data_req(wm, req);
+
+    return blocks;
+}
 
-        /* send the request out immediately */
-        wiiuse_send_next_pending_write_request(wm);
-    } else
+/**
+ *	@brief	Send the next reports of a vectored write.
+ *
+ *	@param wm			Pointer to a wiimote_t structure.
+ *	@param req			The vectored write request.
+ *	@param in_flight	The reports sent ahead of their acknowledgement, counting
+ *						the ones of this request. Updated as reports go out.
+ *
+ *	@return 1 once every report of the request is sent, 0 if some are still waiting.
+ */
+static int wiiuse_send_write_v(struct wiimote_t *wm, struct data_req_t *req, int *in_flight)
+{
+    while (req->sent < req->blocks && *in_flight < WIIUSE_WRITE_WINDOW)
     {
-        struct data_req_t *nptr = wm->data_req;
-        WIIUSE_DEBUG("chaud2fois");
-        for (; nptr->next; nptr = nptr->next)
+        const struct wiiuse_iovec_t *run;
+        byte len;
+
+        /* empty runs send nothing */
+        while (req->iov_offset >= req->iov[req->iov_next].len)
+        {
+            req->iov_offset = 0;
+            ++req->iov_next;
+        }
+        run = &req->iov[req->iov_next];
+        len = (run->len - req->iov_offset > 16) ? 16 : (byte)(run->len - req->iov_offset);
+        if (!wiiuse_take_tokens(wm, len))
         {
-            ;
+            return 0;
         }
-        nptr->next = req;
 
-        WIIUSE_DEBUG("Added pending data write request.");
+        wiiuse_write_data(wm, run->addr + req->iov_offset, run->data + req->iov_offset, len);
+
+        req->iov_offset += len;
+        ++req->sent;
+        req->state = REQ_SENT;
+        ++*in_flight;
     }
 
-    return 1;
+    return req->sent == req->blocks;
 }
 
 /**
@@ -705,29 +1041,118 @@ int wiiuse_write_data_cb(struct wiimote_t *wm, unsigned int addr, byte *data, by
 void wiiuse_send_next_pending_write_request(struct wiimote_t *wm)
 {
     struct data_req_t *req;
+    int in_flight = 0;
 
     if (!wm || !WIIMOTE_IS_CONNECTED(wm))
     {
         return;
     }
-    req = wm->data_req;
-    if (!req)
+
+    /* keep up to WIIUSE_WRITE_WINDOW writes waiting on their acknowledgement */
+    for (req = wm->data_req; req && in_flight < WIIUSE_WRITE_WINDOW; req = req->next)
     {
-        return;
+        if (req->iov)
+        {
+            if (req->state == REQ_DONE)
+            {
+                continue;
+            }
+            in_flight += (int)(req->sent - req->acked);
+            /* writes go out in order, so the rest wait behind its last report */
+            if (!wiiuse_send_write_v(wm, req, &in_flight))
+            {
+                break;
+            }
+            continue;
+        }
+        if (req->state == REQ_SENT)
+        {
+            ++in_flight;
+            continue;
+        }
+        if (req->state != REQ_READY || !req->len)
+        {
+            continue;
+        }
+        /* writes go out in order, so the rest wait behind this one */
+        if (!wiiuse_take_tokens(wm, req->len))
+        {
+            break;
+        }
+
+        wiiuse_write_data(wm, req->addr, req->data, req->len);
+
+        req->state = REQ_SENT;
+        ++in_flight;
     }
-    if (!req->len)
+}
+
+/**
+ *	@brief	Ask the wiimote again for what it left unanswered.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *
+ *	@return The number of requests sent again.
+ *
+ *	A lost reply leaves its request waiting for ever, so a caller that has
+ *	waited long enough on one calls this instead of reconnecting. The read
+ *	in flight is asked for again from the first packet it is missing, and
+ *	the oldest report of the vectored write in flight is written again, its
+ *	acknowledgement standing in for the lost one. Writes of the same bytes
+ *	leave the wiimote as it was, and packets a read already has are ignored.
+ */
+int wiiuse_resend_requests(struct wiimote_t *wm)
+{
+    struct read_req_t *rreq;
+    struct data_req_t *wreq;
+    int resent = 0;
+
+    if (!wm || !WIIMOTE_IS_CONNECTED(wm))
     {
-        return;
+        return 0;
     }
-    if (req->state != REQ_READY)
+
+    rreq = wm->read_req;
+    while (rreq && rreq->dirty)
     {
-        return;
+        rreq = rreq->next;
+    }
+    if (rreq && !wm->read_held)
+    {
+        byte buf[6];
+        uint16_t done = rreq->size - rreq->wait;
+
+        to_big_endian_uint32_t(buf, rreq->addr + done);
+        to_big_endian_uint16_t(buf + 4, rreq->wait);
+
+        WIIUSE_DEBUG("Asking again for read at address: 0x%x  length: %i", rreq->addr + done, rreq->wait);
+        wiiuse_send(wm, WM_CMD_READ_DATA, buf, 6);
+        ++resent;
     }
 
-    wiiuse_write_data(wm, req->addr, req->data, req->len);
+    wreq = wm->data_req;
+    while (wreq && wreq->state == REQ_DONE)
+    {
+        wreq = wreq->next;
+    }
+    if (wreq && wreq->iov && wreq->state == REQ_SENT && wreq->acked < wreq->sent)
+    {
+        const struct wiiuse_iovec_t *run = wreq->iov;
+        unsigned int block               = wreq->acked;
 
-    req->state = REQ_SENT;
-    return;
+        /* find the report the next acknowledgement is counted against */
+        while (block >= WIIUSE_WRITE_BLOCKS(run->len))
+        {
+            block -= WIIUSE_WRITE_BLOCKS(run->len);
+            ++run;
+        }
+        WIIUSE_DEBUG("Writing report %u of %u again.", wreq->acked, wreq->blocks);
+        wiiuse_write_data(wm, run->addr + block * 16, run->data + block * 16,
+                          (run->len - block * 16 > 16) ? 16 : (byte)(run->len - block * 16));
+        ++resent;
+    }
+
+    return resent;
 }
 
 /**
@@ -958,3 +1383,83 @@ void wiiuse_set_timeout(struct wiimote_t **wm, int wiimotes, byte normal_timeout
     }
 #endif
 }
+
+/**
+ *	@brief Limit how fast memory reads and writes are sent to a wiimote.
+ *
+ *	@param wm				Pointer to a wiimote_t structure.
+ *	@param bytes_per_sec	Bytes a second the requests may carry, 0 to send them as fast as they are
+ *							acknowledged.
+ *	@param burst			Bytes the requests may carry at once, after the wiimote was left alone.
+ *
+ *	Requests go through a token bucket: a write costs the bytes it writes,
+ *	a read the bytes it asks for.  Held back requests are sent from
+ *	wiiuse_poll(), which wakes up for them.  Only needed for remotes that
+ *	drop requests sent as fast as the acknowledgements come back.
+ */
+void wiiuse_set_rate_limit(struct wiimote_t *wm, unsigned int bytes_per_sec, unsigned int burst)
+{
+    if (!wm)
+    {
+        return;
+    }
+
+    /* a burst smaller than a write would let a full 16 byte write through for less */
+    wm->rate_limit    = bytes_per_sec;
+    wm->rate_burst    = burst < 16 ? 16 : burst;
+    wm->rate_tokens   = (uint64_t)wm->rate_burst * 1000000;
+    wm->rate_refilled = wiiuse_os_ticks_us();
+
+    /* without a limit nothing is held back, send whatever was */
+    if (!bytes_per_sec)
+    {
+        wiiuse_send_held_requests(&wm, 1, 0);
+    }
+}
+
+/**
+ *	@brief Send the requests the rate limit held back, once it lets them through.
+ *
+ *	@param wm			An array of pointers to wiimote_t structures.
+ *	@param wiimotes		The number of wiimote_t structures in the \a wm array.
+ *	@param timeout_ms	How long the caller means to wait for a report, -1 for ever.
+ *
+ *	@return Returns the timeout, cut short to when the next held back request can go out.
+ *
+ *	This function is not part of the wiiuse API.
+ */
+int wiiuse_send_held_requests(struct wiimote_t **wm, int wiimotes, int timeout_ms)
+{
+    uint64_t wait_us;
+    int i;
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        if (!wm[i] || !wm[i]->rate_need)
+        {
+            continue;
+        }
+
+        wm[i]->rate_need = 0;
+        if (wm[i]->read_held)
+        {
+            wm[i]->read_held = 0;
+            wiiuse_send_next_pending_read_request(wm[i]);
+        }
+        wiiuse_send_next_pending_write_request(wm[i]);
+        if (!wm[i]->rate_need)
+        {
+            continue;
+        }
+
+        /* the bucket fills at rate_limit millionths a microsecond */
+        wait_us = ((uint64_t)wm[i]->rate_need * 1000000 - wm[i]->rate_tokens + wm[i]->rate_limit - 1) /
+                  wm[i]->rate_limit;
+        if (timeout_ms < 0 || (wait_us + 999) / 1000 < (uint64_t)timeout_ms)
+        {
+            timeout_ms = (int)((wait_us + 999) / 1000);
+        }
+    }
+
+    return timeout_ms;
+}
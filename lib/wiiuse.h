@@ -738,9 +738,19 @@ typedef struct wiimote_t
     bdaddr_t bdaddr;     /**< bt address								*/
     int out_sock;        /**< output socket							*/
     int in_sock;         /**< input socket 							*/
+    int readable;        /**< in_sock may still hold unread reports	*/
                                 /** @} */
 #endif
 
+#ifdef WIIUSE_SIM
+    /** @name Simulator members */
+    /** @{ */
+    char bdaddr_str[18];      /**< readable address of the simulated remote	*/
+    int in_sock;              /**< library end of the socketpair			*/
+    struct sim_remote_t *sim; /**< the simulated remote						*/
+                              /** @} */
+#endif
+
 #ifdef WIIUSE_WIN32
     /** @name Windows-specific members */
     /** @{ */
@@ -769,10 +779,16 @@ typedef struct wiimote_t
 #ifndef WIIUSE_SYNC_HANDSHAKE
     byte handshake_state; /**< the state of the connection handshake	*/
 #endif
-    byte expansion_state;        /**< the state of the expansion handshake	*/
-    struct data_req_t *data_req; /**< list of data read requests				*/
+    byte expansion_state;             /**< the state of the expansion handshake	*/
+    struct data_req_t *data_req;      /**< list of data read requests				*/
+    struct data_req_t *data_req_tail; /**< last request in data_req, if there is one	*/
+
+    struct read_req_t *read_req;      /**< list of data read requests				*/
+    struct read_req_t *read_req_tail; /**< last request in read_req, if there is one	*/
 
-    struct read_req_t *read_req; /**< list of data read requests				*/
+    struct read_req_t *free_read_req; /**< read requests ready for reuse			*/
+    struct data_req_t *free_data_req; /**< write requests ready for reuse			*/
+    void *req_slabs;                  /**< memory the requests are carved from	*/
     struct accel_t accel_calib;  /**< wiimote accelerometer calibration		*/
     struct expansion_t exp;      /**< wiimote expansion device				*/
 
@@ -794,8 +810,40 @@ typedef struct wiimote_t
     WIIUSE_EVENT_TYPE event; /**< type of event that occurred				*/
     byte motion_plus_id[6];
     WIIUSE_WIIMOTE_TYPE type;
+
+    struct rx_queue_t *rx_queue; /**< reports held back by synchronous reads	*/
+
+    unsigned int rate_limit; /**< bytes a second requests may carry, 0 for no limit	*/
+    unsigned int rate_burst; /**< bytes requests may carry at once			*/
+    unsigned int rate_need;  /**< bytes the request held back carries, 0 if none	*/
+    int read_held;           /**< the next read request was held back		*/
+    uint64_t rate_tokens;    /**< bytes in the bucket, in millionths			*/
+    uint64_t rate_refilled;  /**< when the bucket was last topped up, in us		*/
+
+    unsigned int replies; /**< read packets and write acknowledgements taken	*/
 } wiimote;
 
+#ifdef WIIUSE_SIM
+/**
+ *	@brief How the simulated remotes behave.
+ *
+ *	Without a call to wiiuse_sim_configure() every field is read from the
+ *	environment variable of the same name, upper case and prefixed with
+ *	WIIUSE_SIM_, e.g. WIIUSE_SIM_LATENCY_US.
+ */
+typedef struct wiiuse_sim_config_t
+{
+    int remotes;                       /**< how many remotes an inquiry can find, at most 8	*/
+    unsigned long latency_us;          /**< delay before a reply arrives					*/
+    unsigned long jitter_us;           /**< random extra delay, up to this much			*/
+    unsigned long report_us;           /**< least time between two reports				*/
+    unsigned long drop_permille;       /**< replies lost, per thousand					*/
+    unsigned long interleave_permille; /**< button reports slipped in before replies	*/
+    const char *eeprom_dir;            /**< where eeproms persist, NULL for memory only	*/
+    unsigned int seed;                 /**< seed for drops, jitter and interleaving		*/
+} wiiuse_sim_config;
+#endif
+
 /** @brief Data passed to a callback during wiiuse_update() */
 typedef struct wiimote_callback_data_t
 {
@@ -834,6 +882,38 @@ typedef void (*wiiuse_write_cb)(struct wiimote_t *wm, unsigned char *data, unsig
 
 typedef enum data_req_s { REQ_READY = 0, REQ_SENT, REQ_DONE } data_req_s;
 
+/**
+ *	@struct wiiuse_iovec_t
+ *	@brief One run of bytes for wiiuse_write_data_v() to write.
+ */
+struct wiiuse_iovec_t
+{
+    unsigned int addr; /**< where in the wiimote's memory the run goes			*/
+    const byte *data;  /**< the bytes, left in place until the write completes	*/
+    unsigned int len;  /**< any length, the run is sent as 16 byte reports		*/
+};
+
+/** @brief Status of a report of a vectored write that is not acknowledged yet */
+#define WIIUSE_WRITE_PENDING 0xff
+
+/** @brief Number of reports a run of len bytes is sent as */
+#define WIIUSE_WRITE_BLOCKS(len) (((len) + 15) / 16)
+
+/**
+ *      @brief Callback that handles the completion of a vectored write.
+ *
+ *      @param wm               Pointer to a wiimote_t structure.
+ *      @param status           The status of every report, in the order they were sent.
+ *      @param blocks           The number of reports.
+ *      @param arg              The argument given to wiiuse_write_data_v().
+ *
+ *      @see wiiuse_write_data_v()
+ *
+ *      Called once the wiimote has acknowledged the last report. A status is 0
+ *      for a report that was written, and the wiimote's error code otherwise.
+ */
+typedef void (*wiiuse_write_v_cb)(struct wiimote_t *wm, const byte *status, unsigned int blocks, void *arg);
+
 /**
  *	@struct data_req_t
  *	@brief Data write request structure.
@@ -847,6 +927,19 @@ struct data_req_t
     data_req_s state;   /**< set to 1 if not using callback and needs to be cleaned up	*/
     wiiuse_write_cb cb; /**< read data callback
                            */
+
+    /* a vectored write sends all of its runs from this one request */
+    const struct wiiuse_iovec_t *iov; /**< the runs to write, NULL for a single block		*/
+    int iovcnt;
+    int iov_next;                 /**< the run the next report comes from				*/
+    unsigned int iov_offset;      /**< where in that run the next report starts			*/
+    unsigned int blocks;          /**< reports the runs are split into					*/
+    unsigned int sent;            /**< reports sent so far								*/
+    unsigned int acked;           /**< reports acknowledged so far						*/
+    byte *status;                 /**< the status of every report, see wiiuse_write_v_cb	*/
+    wiiuse_write_v_cb write_v_cb; /**< called once the last report is acknowledged		*/
+    void *arg;
+
     struct data_req_t *next;
 };
 
@@ -891,6 +984,7 @@ extern "C" {
 
 /* wiiuse.c */
 WIIUSE_EXPORT extern const char *wiiuse_version();
+WIIUSE_EXPORT extern uint64_t wiiuse_ticks_us();
 
 /** @brief Define indicating the presence of the feature allowing you to
  *  redirect output for one or more logging levels within the library.
@@ -909,6 +1003,10 @@ WIIUSE_EXPORT extern int wiiuse_read_data(struct wiimote_t *wm, byte *buffer, un
                                           uint16_t len);
 WIIUSE_EXPORT extern int wiiuse_write_data(struct wiimote_t *wm, unsigned int addr, const byte *data,
                                            byte len);
+WIIUSE_EXPORT extern unsigned int wiiuse_write_data_v(struct wiimote_t *wm, const struct wiiuse_iovec_t *iov,
+                                                      int iovcnt, byte *status, wiiuse_write_v_cb cb,
+                                                      void *arg);
+WIIUSE_EXPORT extern int wiiuse_resend_requests(struct wiimote_t *wm);
 WIIUSE_EXPORT extern void wiiuse_status(struct wiimote_t *wm);
 WIIUSE_EXPORT extern struct wiimote_t *wiiuse_get_by_id(struct wiimote_t **wm, int wiimotes, int unid);
 WIIUSE_EXPORT extern int wiiuse_set_flags(struct wiimote_t *wm, int enable, int disable);
@@ -920,15 +1018,24 @@ WIIUSE_EXPORT extern void wiiuse_resync(struct wiimote_t *wm);
 WIIUSE_EXPORT extern void wiiuse_set_timeout(struct wiimote_t **wm, int wiimotes, byte normal_timeout,
                                              byte exp_timeout);
 WIIUSE_EXPORT extern void wiiuse_set_accel_threshold(struct wiimote_t *wm, int threshold);
+WIIUSE_EXPORT extern void wiiuse_set_rate_limit(struct wiimote_t *wm, unsigned int bytes_per_sec,
+                                                unsigned int burst);
 WIIUSE_EXPORT extern void wiiuse_wiiboard_use_alternate_report(struct wiimote_t *wm, int enabled);
 
 /* io.c */
 WIIUSE_EXPORT extern int wiiuse_find(struct wiimote_t **wm, int max_wiimotes, int timeout);
 WIIUSE_EXPORT extern int wiiuse_connect(struct wiimote_t **wm, int wiimotes);
+WIIUSE_EXPORT extern int wiiuse_connect_address(struct wiimote_t *wm, const char *address);
 WIIUSE_EXPORT extern void wiiuse_disconnect(struct wiimote_t *wm);
 
+#ifdef WIIUSE_SIM
+/* os_sim.c */
+WIIUSE_EXPORT extern void wiiuse_sim_configure(const struct wiiuse_sim_config_t *config);
+#endif
+
 /* events.c */
 WIIUSE_EXPORT extern int wiiuse_poll(struct wiimote_t **wm, int wiimotes);
+WIIUSE_EXPORT extern int wiiuse_poll_timeout(struct wiimote_t **wm, int wiimotes, int timeout_ms);
 
 /**
  *  @brief Poll Wiimotes, and call the provided callback with information
@@ -72,6 +72,10 @@
 #include <arpa/inet.h> /* htons() */
 #include <bluetooth/bluetooth.h>
 #endif
+#ifdef WIIUSE_SIM
+#include <arpa/inet.h> /* htons() */
+#include <string.h>    /* memcpy(), which bluetooth.h brings in otherwise */
+#endif
 #ifdef WIIUSE_MAC
 /* mac */
 #include <CoreFoundation/CoreFoundation.h>  /*CFRunLoops and CFNumberRef in Bluetooth classes*/
@@ -276,6 +280,18 @@
 
 #define WIIUSE_READ_TIMEOUT 5000
 
+/* number of queued memory writes sent ahead of their acknowledgement */
+#define WIIUSE_WRITE_WINDOW 4
+
+/* milliseconds wiiuse_poll() waits for a report */
+#define WIIUSE_POLL_TIMEOUT 1
+
+/* reports a synchronous read can hold back for wiiuse_poll() */
+#define WIIUSE_RX_QUEUE_SIZE 32
+
+/* read or write requests allocated at a time once a wiimote has none spare */
+#define WIIUSE_REQ_SLAB 64
+
 /** @} */
 #include "wiiuse.h"
 /** @addtogroup internal_general */
@@ -298,6 +314,19 @@ extern "C" {
 
 /* not part of the api */
 
+/**
+ *	@brief Reports received while a synchronous read waited for another one.
+ *
+ *	Oldest first.  wiiuse_poll() hands them to propagate_event() before
+ *	it reads anything new, so they are seen in the order they arrived.
+ */
+struct rx_queue_t
+{
+    byte report[WIIUSE_RX_QUEUE_SIZE][MAX_PAYLOAD];
+    byte head;
+    byte count;
+};
+
 /** @brief Cross-platform call to sleep for at least the specified number
  * of milliseconds.
  *
@@ -307,8 +336,13 @@ extern "C" {
 void wiiuse_millisleep(int durationMilliseconds);
 
 int wiiuse_set_report_type(struct wiimote_t *wm);
+struct read_req_t *wiiuse_alloc_read_req(struct wiimote_t *wm);
+void wiiuse_free_read_req(struct wiimote_t *wm, struct read_req_t *req);
+struct data_req_t *wiiuse_alloc_data_req(struct wiimote_t *wm);
+void wiiuse_free_data_req(struct wiimote_t *wm, struct data_req_t *req);
 void wiiuse_send_next_pending_read_request(struct wiimote_t *wm);
 void wiiuse_send_next_pending_write_request(struct wiimote_t *wm);
+int wiiuse_send_held_requests(struct wiimote_t **wm, int wiimotes, int timeout_ms);
 int wiiuse_send(struct wiimote_t *wm, byte report_type, byte *msg, int len);
 int wiiuse_read_data_cb(struct wiimote_t *wm, wiiuse_read_cb read_cb, byte *buffer, unsigned int offset,
                         uint16_t len);
@@ -0,0 +1,455 @@
+/**
+ * bench
+ *
+ * purpose: to measure how fast files move on and off of
+ *      remotes, without any remotes. synthetic files of
+ *      several sizes are uploaded to simulated remotes,
+ *      downloaded again and compared, then changed by a
+ *      byte and uploaded again, under a range of
+ *      link profiles. every run prints one json line,
+ *      so results can be compared between builds
+ *
+ * usage: wiimote_bench [profile_file]
+ *      a profile file has one profile per line:
+ *      name latency_us jitter_us report_us drop_permille interleave_permille
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> /* for dup */
+
+#include "wiiuse.h"
+
+#include "cache.h"
+#include "journal.h"
+#include "transfer.h"
+#include "wpf_handler.h"
+
+#define MAX_PROFILES 16
+#define MAX_RECONNECTS 10                  // reconnects before a run is given up on
+#define MAX_SAMPLES (TRANSFER_BLOCKS * 16) // block latencies kept per transfer
+#define BENCH_SEED 0x5eed
+
+typedef struct Profile
+{
+    char name[32];
+    unsigned long latency_us;
+    unsigned long jitter_us;
+    unsigned long report_us;
+    unsigned long drop_permille;
+    unsigned long interleave_permille;
+} Profile;
+
+// used when no profile file is given
+static const Profile default_profiles[] = {
+    {"ideal", 0, 0, 0, 0, 0},
+    {"typical", 1500, 500, 700, 0, 20},
+    {"slow", 8000, 4000, 1500, 0, 50},
+    {"lossy", 1500, 500, 700, 5, 20},
+};
+
+static const uint32_t sizes[] = {256, 1024, 4096, 5248, 10000};
+
+// the real stdout, the transfers print their progress to the one that is silenced
+static FILE *out;
+
+typedef struct Result
+{
+    int ok;
+    uint32_t bytes;
+    uint64_t elapsed_us;
+    uint32_t requests;
+    uint32_t retries;
+    uint32_t reconnects;
+    uint32_t p50_us;
+    uint32_t p99_us;
+} Result;
+
+/**
+ * @brief load_profiles
+ *
+ * @param char* file_name - the profile file
+ * @param Profile* profiles - an array of MAX_PROFILES profiles to fill in
+ *
+ * @returns the number of profiles read
+ */
+static int load_profiles(char *file_name, Profile *profiles)
+{
+    FILE *fp;
+    char line[256];
+    int count = 0;
+
+    if (fopen_s(&fp, file_name, "r"))
+        return 0;
+    while (count < MAX_PROFILES && fgets(line, sizeof(line), fp))
+    {
+        Profile *p = &profiles[count];
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%31s %lu %lu %lu %lu %lu", p->name, &p->latency_us, &p->jitter_us, &p->report_us,
+                   &p->drop_permille, &p->interleave_permille) == 6)
+            count++;
+    }
+    fclose(fp);
+
+    return count;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief connect_all
+ *
+ * @param Profile* profile - how the simulated link behaves
+ *
+ * @returns every simulated remote, connected
+ */
+static wiimote **connect_all(const Profile *profile)
+{
+    wiiuse_sim_config config;
+    wiimote **remotes = wiiuse_init(MAX_WIIMOTES);
+
+    // the eeproms stay in memory, so they outlive reconnects but not the benchmark
+    memset(&config, 0, sizeof(config));
+    config.remotes             = MAX_WIIMOTES;
+    config.latency_us          = profile->latency_us;
+    config.jitter_us           = profile->jitter_us;
+    config.report_us           = profile->report_us;
+    config.drop_permille       = profile->drop_permille;
+    config.interleave_permille = profile->interleave_permille;
+    config.seed                = BENCH_SEED;
+    wiiuse_sim_configure(&config);
+
+    wiiuse_find(remotes, MAX_WIIMOTES, 1);
+    wiiuse_connect(remotes, MAX_WIIMOTES);
+
+    return remotes;
+}
+
+/**
+ * @brief run_all
+ *
+ * @param wiimote*** remotes - the connected remotes, replaced when they are reconnected
+ * @param Transfer* transfers, int count, Result* result
+ *
+ * @returns 1 once every transfer is done, 0 if they kept failing
+ *
+ * runs the transfers, reconnecting and resuming the ones that fail the same way main does
+ */
+static int run_all(wiimote ***remotes, Transfer *transfers, int count, const Profile *profile, Result *result)
+{
+    while (run_transfers(transfers, count))
+    {
+        int i;
+
+        for (i = 0; i < count; i++)
+        {
+            if (transfers[i].state == TRANSFER_INVALID)
+                return 0;
+        }
+        if (++result->reconnects > MAX_RECONNECTS)
+            return 0;
+
+        // a reconnect throws away the requests that lost their replies
+        wiiuse_cleanup(*remotes, MAX_WIIMOTES);
+        *remotes = connect_all(profile);
+        for (i = 0; i < count; i++)
+        {
+            wiimote *remote = find_remote(*remotes, MAX_WIIMOTES, transfers[i].remote_addr);
+            if (!remote)
+                return 0;
+            if (transfers[i].state == TRANSFER_FAILED)
+                resume_transfer(&transfers[i], remote);
+            else
+                transfers[i].remote = remote;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief list_all
+ *
+ * @param wiimote*** remotes - the connected remotes, replaced when they are reconnected
+ * @param Transfer* listings - a transfer per remote to read its directory into
+ * @param int count - the number of remotes to list
+ *
+ * @returns 1 once every directory is read, 0 if they couldn't be. the
+ *      listings count towards the result, main lists before every transfer too
+ */
+static int list_all(wiimote ***remotes, Transfer *listings, int count, const Profile *profile, Result *result)
+{
+    int i, ok;
+
+    for (i = 0; i < count; i++)
+        init_listing(&listings[i], (*remotes)[i]);
+    ok = run_all(remotes, listings, count, profile, result);
+    for (i = 0; i < count; i++)
+        result->requests += listings[i].requests;
+
+    return ok;
+}
+
+/**
+ * @brief start_stats
+ *
+ * @param Transfer* transfers, TransferStats* stats, int count, uint32_t capacity
+ * @param uint64_t start - when the transfers were set up
+ */
+static void start_stats(Transfer *transfers, TransferStats *stats, int count, uint32_t capacity, uint64_t start)
+{
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        memset(&stats[i], 0, sizeof(TransferStats));
+        stats[i].latency_us = malloc(capacity * sizeof(uint32_t));
+        stats[i].capacity   = stats[i].latency_us ? capacity : 0;
+        stats[i].last_us    = start;
+        transfers[i].stats  = &stats[i];
+    }
+}
+
+/**
+ * @brief finish_stats
+ *
+ * @param Transfer* transfers, TransferStats* stats, int count, uint64_t start, Result* result
+ *
+ * adds every transfer's numbers up into the result, and frees them
+ */
+static void finish_stats(Transfer *transfers, TransferStats *stats, int count, uint64_t start, Result *result)
+{
+    uint32_t *all;
+    uint32_t total = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+        total += stats[i].samples;
+    all = malloc((total ? total : 1) * sizeof(uint32_t));
+
+    total = 0;
+    for (i = 0; i < count; i++)
+    {
+        result->requests += transfers[i].requests;
+        result->retries += stats[i].retries;
+        // the last block through ends the run, alerting the remotes after that is not part of it
+        if (stats[i].last_us - start > result->elapsed_us)
+            result->elapsed_us = stats[i].last_us - start;
+        if (all)
+        {
+            memcpy(all + total, stats[i].latency_us, stats[i].samples * sizeof(uint32_t));
+            total += stats[i].samples;
+        }
+        free(stats[i].latency_us);
+    }
+
+    if (all && total)
+    {
+        qsort(all, total, sizeof(uint32_t), compare_samples);
+        result->p50_us = all[total / 2];
+        result->p99_us = all[(total * 99) / 100];
+    }
+    free(all);
+}
+
+static void print_result(const Profile *profile, uint32_t size, char *phase, Result *result)
+{
+    double seconds = result->elapsed_us / 1e6;
+
+    fprintf(out,
+            "{\"profile\":\"%s\",\"size\":%u,\"phase\":\"%s\",\"ok\":%d,\"bytes\":%u,\"seconds\":%.6f,"
+            "\"bytes_per_s\":%.1f,\"round_trips_per_kb\":%.2f,\"retries\":%u,\"reconnects\":%u,"
+            "\"p50_us\":%u,\"p99_us\":%u}\n",
+            profile->name, size, phase, result->ok, result->bytes, seconds,
+            seconds > 0 ? result->bytes / seconds : 0.0,
+            result->bytes ? result->requests * 1024.0 / result->bytes : 0.0, result->retries,
+            result->reconnects, result->p50_us, result->p99_us);
+    fflush(out);
+}
+
+/**
+ * @brief bench_cycle
+ *
+ * @param Profile* profile - how the simulated link behaves
+ * @param uint32_t size - how big a file to move
+ *
+ * uploads a file of the given size, downloads it again and compares the two,
+ * then changes a byte of it and uploads it again over the old version
+ */
+static void bench_cycle(const Profile *profile, uint32_t size)
+{
+    Transfer *up   = calloc(MAX_WIIMOTES, sizeof(Transfer));
+    Transfer *down = calloc(MAX_WIIMOTES, sizeof(Transfer));
+    Transfer *list = calloc(MAX_WIIMOTES, sizeof(Transfer));
+    TransferStats stats[MAX_WIIMOTES];
+    WiimotePartialFile wpf;
+    Result upload, download, update;
+    char name[17], ext[17];
+    char *source = malloc(size);
+    wiimote **remotes;
+    uint64_t start;
+    uint32_t i;
+    int parts, j;
+
+    memset(&upload, 0, sizeof(Result));
+    memset(&download, 0, sizeof(Result));
+    memset(&update, 0, sizeof(Result));
+    if (!up || !down || !list || !source)
+        goto out;
+
+    // the same random bytes every time, they don't compress so every size is what it says
+    srand(size);
+    for (i = 0; i < size; i++)
+        source[i] = (char)(rand() >> 7);
+    wpf.file_name = name;
+    wpf.file_ext  = ext;
+    if (!prepare_data("bench.bin", source, size, &wpf) || wpf.tot_wpf > MAX_WIIMOTES)
+        goto out;
+    parts = wpf.tot_wpf;
+
+    // the remotes keep what earlier cycles left on them, the new parts replace those of the same name
+    remotes = connect_all(profile);
+    start   = wiiuse_ticks_us();
+    if (!list_all(&remotes, list, parts, profile, &upload))
+    {
+        release_data(&wpf);
+        print_result(profile, size, "upload", &upload);
+        goto done;
+    }
+    for (j = 0; j < parts; j++)
+    {
+        wpf.cur_wpf = j + 1;
+        if (!init_upload(&up[j], list[j].remote, &wpf, &list[j].dir, NULL, 0))
+        {
+            release_data(&wpf);
+            goto done;
+        }
+        upload.bytes += up[j].size;
+    }
+    release_data(&wpf);
+
+    start_stats(up, stats, parts, MAX_SAMPLES, start);
+    upload.ok = run_all(&remotes, up, parts, profile, &upload);
+    finish_stats(up, stats, parts, start, &upload);
+    print_result(profile, size, "upload", &upload);
+    if (!upload.ok)
+        goto done;
+
+    // read it all back, into fresh transfers, finding every part the way main does
+    start = wiiuse_ticks_us();
+    if (!list_all(&remotes, list, parts, profile, &download))
+    {
+        print_result(profile, size, "download", &download);
+        goto done;
+    }
+    for (j = 0; j < parts; j++)
+    {
+        int e = dir_find(&list[j].dir, name, ext, j + 1);
+        if (e < 0)
+        {
+            print_result(profile, size, "download", &download);
+            goto done;
+        }
+        init_download(&down[j], list[j].remote, &list[j].dir, &list[j].dir.entries[e], NULL);
+    }
+    start_stats(down, stats, parts, MAX_SAMPLES, start);
+    download.ok = run_all(&remotes, down, parts, profile, &download);
+    finish_stats(down, stats, parts, start, &download);
+
+    // every part has to come back exactly as it went up
+    for (j = 0; j < parts && download.ok; j++)
+    {
+        download.bytes += down[j].size;
+        if (down[j].size != up[j].size || memcmp(down[j].buffer, up[j].buffer, up[j].size))
+            download.ok = 0;
+    }
+    print_result(profile, size, "download", &download);
+    if (!download.ok)
+        goto done;
+
+    // an edit in the middle of the file only changes a few blocks of one part, and the headers
+    source[size / 2] ^= 0x5a;
+    if (!prepare_data("bench.bin", source, size, &wpf))
+        goto done;
+    start = wiiuse_ticks_us();
+    if (!list_all(&remotes, list, parts, profile, &update))
+    {
+        release_data(&wpf);
+        print_result(profile, size, "update", &update);
+        goto done;
+    }
+    for (j = 0; j < parts; j++)
+    {
+        wpf.cur_wpf = j + 1;
+        if (!init_upload(&up[j], list[j].remote, &wpf, &list[j].dir, NULL, 1))
+        {
+            release_data(&wpf);
+            goto done;
+        }
+        update.bytes += up[j].size;
+    }
+    release_data(&wpf);
+
+    start_stats(up, stats, parts, MAX_SAMPLES, start);
+    update.ok = run_all(&remotes, up, parts, profile, &update);
+    finish_stats(up, stats, parts, start, &update);
+    print_result(profile, size, "update", &update);
+
+done:
+    journal_clear();
+    wiiuse_cleanup(remotes, MAX_WIIMOTES);
+out:
+    free(up);
+    free(down);
+    free(list);
+    free(source);
+}
+
+int main(int argc, char **argv)
+{
+    Profile profiles[MAX_PROFILES];
+    int count = 0;
+    int i;
+    unsigned int s;
+
+    if (argc > 2)
+    {
+        printf("usage: %s [profile_file]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 2)
+    {
+        count = load_profiles(argv[1], profiles);
+        if (!count)
+        {
+            printf("[ERROR] No profiles in %s\n", argv[1]);
+            return 1;
+        }
+    } else
+    {
+        count = sizeof(default_profiles) / sizeof(Profile);
+        memcpy(profiles, default_profiles, sizeof(default_profiles));
+    }
+
+    // every byte has to go over the link to be measured, copies of the eeproms would skip most of them
+    cache_enable(0);
+
+    // the results go to stdout, everything the transfers and wiiuse print goes nowhere
+    out = fdopen(dup(fileno(stdout)), "w");
+    if (!out || !freopen("/dev/null", "w", stdout))
+        return 1;
+
+    for (i = 0; i < count; i++)
+    {
+        for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            bench_cycle(&profiles[i], sizes[s]);
+    }
+    fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+/**
+ * cache
+ *
+ * purpose: to keep a copy of every remote's eeprom on the
+ *      host, checked against the generation and table
+ *      crc32 of the remote's directory before any of it
+ *      is used
+ */
+
+#include "cache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CACHE_MAGIC 0x57454333 // "WEC3"
+
+typedef struct Cache
+{
+    uint32_t magic;
+    uint32_t count;
+    uint32_t clock; // lookups so far, for telling which remote was used longest ago
+    CachedRemote remotes[CACHE_REMOTES];
+} Cache;
+
+static Cache cache;
+static int enabled = 1;
+static int loaded  = 0;
+static int dirty   = 0;
+
+void cache_enable(int enable) { enabled = enable; }
+
+/**
+ * @brief load_cache
+ *
+ * reads the cache off disk the first time it is needed, a cache
+ * from another build or one that was cut off starts out empty
+ */
+static void load_cache()
+{
+    FILE *fp;
+
+    if (loaded)
+        return;
+    loaded = 1;
+    if (fopen_s(&fp, CACHE_FILE, "rb"))
+        return;
+    if (fread(&cache, sizeof(Cache), 1, fp) != 1 || cache.magic != CACHE_MAGIC || cache.count > CACHE_REMOTES)
+        memset(&cache, 0, sizeof(Cache));
+    fclose(fp);
+}
+
+static int block_known(CachedRemote *c, uint32_t block) { return (c->blocks[block / 8] >> (block % 8)) & 1; }
+
+CachedRemote *cache_find(char *remote_addr)
+{
+    uint32_t i;
+
+    if (!enabled)
+        return NULL;
+    load_cache();
+    for (i = 0; i < cache.count; i++)
+    {
+        if (!strcmp(cache.remotes[i].remote_addr, remote_addr))
+        {
+            cache.remotes[i].used = ++cache.clock;
+            return &cache.remotes[i];
+        }
+    }
+
+    return NULL;
+}
+
+CachedRemote *cache_open(char *remote_addr, uint32_t generation, uint32_t table_crc)
+{
+    CachedRemote *c = cache_find(remote_addr);
+    uint32_t i;
+
+    if (!enabled)
+        return NULL;
+    if (c && c->generation == generation && c->table_crc == table_crc)
+        return c;
+
+    // a new remote takes a free slot, or the one of the remote used longest ago
+    if (!c && cache.count < CACHE_REMOTES)
+    {
+        c = &cache.remotes[cache.count++];
+    } else if (!c)
+    {
+        c = &cache.remotes[0];
+        for (i = 1; i < cache.count; i++)
+        {
+            if (cache.remotes[i].used < c->used)
+                c = &cache.remotes[i];
+        }
+    }
+
+    // someone wrote to the remote since the copy was made, none of it can be trusted
+    memset(c, 0, sizeof(CachedRemote));
+    strcpy(c->remote_addr, remote_addr);
+    c->generation = generation;
+    c->table_crc  = table_crc;
+    c->used       = ++cache.clock;
+    dirty         = 1;
+
+    return c;
+}
+
+CachedRemote *cache_commit(char *remote_addr, uint32_t generation, uint32_t table_crc)
+{
+    CachedRemote *c = cache_find(remote_addr);
+
+    // only what was just written changed, and the caller stores that
+    if (c && c->generation + 1 == generation)
+    {
+        c->generation = generation;
+        c->table_crc  = table_crc;
+        dirty         = 1;
+        return c;
+    }
+
+    return cache_open(remote_addr, generation, table_crc);
+}
+
+void cache_store(CachedRemote *c, uint32_t addr, char *data, uint32_t len)
+{
+    uint32_t block;
+
+    if (!c || addr >= MAX_WIIMOTE_PAYLOAD)
+        return;
+    if (len > MAX_WIIMOTE_PAYLOAD - addr)
+        len = MAX_WIIMOTE_PAYLOAD - addr;
+    memcpy(c->image + addr, data, len);
+    for (block = addr / 16; block < (addr + len + 15) / 16; block++)
+        c->blocks[block / 8] |= (1 << (block % 8));
+    dirty = 1;
+}
+
+uint32_t cache_load(CachedRemote *c, uint32_t addr, char *data, uint32_t len, uint8_t *blocks)
+{
+    uint32_t offset;
+    uint32_t copied = 0;
+
+    if (!c || addr >= MAX_WIIMOTE_PAYLOAD)
+        return 0;
+    if (len > MAX_WIIMOTE_PAYLOAD - addr)
+        len = MAX_WIIMOTE_PAYLOAD - addr;
+    for (offset = 0; offset < len; offset += 16)
+    {
+        uint32_t size = (len - offset > 16) ? 16 : len - offset;
+        if (!block_known(c, (addr + offset) / 16))
+            continue;
+        memcpy(data + offset, c->image + addr + offset, size);
+        if (blocks)
+            blocks[offset / 16 / 8] |= (1 << (offset / 16 % 8));
+        copied += size;
+    }
+
+    return copied;
+}
+
+void cache_forget(CachedRemote *c, uint32_t addr, uint32_t len)
+{
+    uint32_t block;
+
+    if (!c)
+        return;
+    for (block = addr / 16; block < (addr + len + 15) / 16 && block < TRANSFER_BLOCKS; block++)
+        c->blocks[block / 8] &= ~(1 << (block % 8));
+    dirty = 1;
+}
+
+void cache_save()
+{
+    FILE *fp;
+
+    if (!enabled || !dirty)
+        return;
+    cache.magic = CACHE_MAGIC;
+    if (fopen_s(&fp, CACHE_FILE, "wb"))
+    {
+        printf("\n[ERROR] Could not write %s\n", CACHE_FILE);
+        return;
+    }
+    fwrite(&cache, sizeof(Cache), 1, fp);
+    fclose(fp);
+    dirty = 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * cache
+ *
+ * purpose: to keep a copy of every remote's eeprom on the
+ *      host, so what this host wrote or read once doesn't
+ *      have to come over the link again. the copy goes with
+ *      the generation of the remote's directory, which every
+ *      upload bumps, and the crc32 of its table. another host
+ *      or a restore can reach the same generation with other
+ *      files, so only while both are the ones the copy was
+ *      made at is the copy good
+ */
+#ifndef CACHE_H
+#define CACHE_H
+#include <stdint.h>
+
+#include "transfer.h"
+
+#define CACHE_FILE "eeprom.cache"
+#define CACHE_REMOTES 8 // remotes remembered, the one used longest ago makes way for a new one
+
+typedef struct CachedRemote
+{
+    char remote_addr[18];
+    uint32_t generation; // of the directory the copy goes with
+    uint32_t table_crc;  // crc32 of that directory's table
+    uint32_t used;       // when the remote was last looked up, counted in lookups
+    // every 16 byte block of image that is known
+    uint8_t blocks[TRANSFER_BLOCK_BYTES];
+    char image[MAX_WIIMOTE_PAYLOAD];
+} CachedRemote;
+
+/**
+ * @brief cache_enable
+ *
+ * @param int enable - 0 to leave the cache alone and go to the remotes for everything
+ */
+void cache_enable(int enable);
+
+/**
+ * @brief cache_find
+ *
+ * @param char* remote_addr - the address from remote_address
+ *
+ * @returns the copy of the remote's eeprom, or NULL if there is none
+ */
+CachedRemote *cache_find(char *remote_addr);
+
+/**
+ * @brief cache_open
+ *
+ * @param char* remote_addr - the address from remote_address
+ * @param uint32_t generation - the generation of the remote's directory
+ * @param uint32_t table_crc - the crc32 of the remote's table
+ *
+ * @returns the copy of the remote's eeprom, emptied first if it was made at another
+ *      generation or with another table, or NULL if the cache is off
+ */
+CachedRemote *cache_open(char *remote_addr, uint32_t generation, uint32_t table_crc);
+
+/**
+ * @brief cache_commit
+ *
+ * @param char* remote_addr - the address from remote_address
+ * @param uint32_t generation - the generation of the directory this host just wrote
+ * @param uint32_t table_crc - the crc32 of the table this host just wrote
+ *
+ * @returns the copy of the remote's eeprom moved on to the new generation, or NULL if
+ *      the cache is off. a copy of the generation before stays good, apart from
+ *      what was just written, which the caller stores
+ */
+CachedRemote *cache_commit(char *remote_addr, uint32_t generation, uint32_t table_crc);
+
+/**
+ * @brief cache_store
+ *
+ * @param CachedRemote* c - may be NULL
+ * @param uint32_t addr, char* data, uint32_t len - what the remote holds at addr
+ *
+ * extents start on 16 byte boundaries, so the rest of a
+ * block a wpf ends in belongs to no other wpf, and the
+ * block counts as known once the wpf's part of it is
+ */
+void cache_store(CachedRemote *c, uint32_t addr, char *data, uint32_t len);
+
+/**
+ * @brief cache_load
+ *
+ * @param CachedRemote* c - may be NULL
+ * @param uint32_t addr, char* data, uint32_t len - where to copy the known blocks to
+ * @param uint8_t* blocks - a bitmap of the blocks of data, the known ones are set. may be NULL
+ *
+ * @returns the number of bytes copied
+ */
+uint32_t cache_load(CachedRemote *c, uint32_t addr, char *data, uint32_t len, uint8_t *blocks);
+
+/**
+ * @brief cache_forget
+ *
+ * @param CachedRemote* c - may be NULL
+ * @param uint32_t addr, uint32_t len - a range about to be written over
+ */
+void cache_forget(CachedRemote *c, uint32_t addr, uint32_t len);
+
+/**
+ * @brief cache_save
+ *
+ * writes the cache to disk, if anything changed
+ */
+void cache_save();
+
+#endif
@@ -0,0 +1,29 @@
+/**
+ * compat
+ *
+ * purpose: to give the secure crt calls the app uses a
+ *      stand-in outside of windows, so it also builds
+ *      against the simulated remotes on linux
+ */
+#ifndef COMPAT_H
+#define COMPAT_H
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <stdio.h>
+#include <unistd.h>
+
+static inline int fopen_s(FILE **fp, const char *name, const char *mode)
+{
+    *fp = fopen(name, mode);
+    return *fp ? 0 : 1;
+}
+
+#define sprintf_s snprintf
+
+static inline void Sleep(unsigned int ms) { usleep(ms * 1000); }
+#endif
+
+#endif
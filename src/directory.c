@@ -0,0 +1,283 @@
+/**
+ * directory
+ *
+ * purpose: to keep the table of the wpfs a remote holds, and
+ *      to find room for new ones
+ *
+ * the table is a 16 byte header followed by DIR_ENTRIES entries:
+ *      header  0x00 magic, 0x04 version, 0x05 flags, 0x08 generation, 0x0c crc32 of the rest of the table
+ *      entry   0x00 name, 0x10 extension, 0x20 offset, 0x22 length,
+ *              0x24 crc32 of the wpf, 0x28 part, 0x2a parts
+ * numbers are big endian, like the wpf header
+ */
+
+#include "directory.h"
+
+#include <string.h>
+
+#include "wpf_handler.h"
+
+#define DIR_MAGIC 0x57464431 // "WFD1"
+#define DIR_VERSION 1
+#define DIR_FLAG_MII_MOVED 0x01
+
+typedef struct EepromRegion
+{
+    uint16_t start;
+    uint16_t end;
+    int mii; // 1 for the Mii blocks, which wpfs may take once their data is kept on the host
+} EepromRegion;
+
+// the parts of the eeprom no wpf goes in, everything else from DIR_DATA_START up is free
+static const EepromRegion reserved[] = {
+    {0x0000, CALIBRATION_SIZE, 0},          // accelerometer and ir calibration
+    {CALIBRATION_SIZE, DIR_ADDR, 0},        // left empty so the table starts on a 16 byte boundary
+    {DIR_ADDR, DIR_DATA_START, 0},          // the table
+    {MII_ADDR, MII_ADDR + MII_SIZE, 1},     // Mii blocks
+    {FACTORY_ADDR, 0x1700, 0},              // factory data, up to the end of user memory
+};
+#define RESERVED_REGIONS (sizeof(reserved) / sizeof(reserved[0]))
+
+static uint16_t get16(char *p) { return (uint16_t)(((uint8_t)p[0] << 8) | (uint8_t)p[1]); }
+
+static uint32_t get32(char *p) { return ((uint32_t)get16(p) << 16) | get16(p + 2); }
+
+static void put16(char *p, uint16_t value)
+{
+    p[0] = (char)(value >> 8);
+    p[1] = (char)value;
+}
+
+static void put32(char *p, uint32_t value)
+{
+    put16(p, (uint16_t)(value >> 16));
+    put16(p + 2, (uint16_t)value);
+}
+
+/**
+ * @brief table_crc
+ *
+ * @param char* image - a whole table
+ *
+ * @returns the crc32 of the table, leaving out the crc itself
+ */
+static uint32_t table_crc(char *image)
+{
+    return crc32_update(crc32_update(0, image, 0x0c), image + 0x10, DIR_SIZE - 0x10);
+}
+
+static int holds_mii(uint32_t start, uint32_t length)
+{
+    return start < MII_ADDR + MII_SIZE && MII_ADDR < start + length;
+}
+
+int dir_parse(char *image, Directory *dir)
+{
+    int i, c;
+
+    memset(dir, 0, sizeof(Directory));
+    if (get32(image) != DIR_MAGIC || image[4] != DIR_VERSION || get32(image + 0x0c) != table_crc(image))
+        return 0;
+    dir->generation = get32(image + 0x08);
+    dir->crc        = get32(image + 0x0c);
+    dir->mii_moved  = (image[5] & DIR_FLAG_MII_MOVED) != 0;
+
+    for (i = 0; i < DIR_ENTRIES; i++)
+    {
+        char *raw   = image + 0x10 + i * DIR_ENTRY_SIZE;
+        DirEntry *e = &dir->entries[i];
+
+        // names are padded the same way as in the wpf header
+        for (c = 0; c < 16 && raw[c] != -52 && raw[c]; c++)
+            e->name[c] = raw[c];
+        for (c = 0; c < 16 && raw[0x10 + c] != -52 && raw[0x10 + c]; c++)
+            e->ext[c] = raw[0x10 + c];
+        e->offset = get16(raw + 0x20);
+        e->length = get16(raw + 0x22);
+        e->crc    = get32(raw + 0x24);
+        e->part   = get16(raw + 0x28);
+        e->parts  = get16(raw + 0x2a);
+
+        // an entry pointing outside the data area can't be trusted, and neither can the rest
+        if (e->length && (e->offset < DIR_DATA_START || e->offset + e->length > MAX_WIIMOTE_PAYLOAD))
+        {
+            memset(dir, 0, sizeof(Directory));
+            return 0;
+        }
+        // earlier builds wrote over the Mii blocks without keeping them, there is nothing left to keep
+        if (e->length && holds_mii(e->offset, e->length))
+            dir->mii_moved = 1;
+    }
+
+    return 1;
+}
+
+void dir_build(Directory *dir, char *image)
+{
+    int i;
+
+    memset(image, 0, DIR_SIZE);
+    put32(image, DIR_MAGIC);
+    image[4] = DIR_VERSION;
+    image[5] = dir->mii_moved ? DIR_FLAG_MII_MOVED : 0;
+    put32(image + 0x08, dir->generation);
+    for (i = 0; i < DIR_ENTRIES; i++)
+    {
+        char *raw   = image + 0x10 + i * DIR_ENTRY_SIZE;
+        DirEntry *e = &dir->entries[i];
+
+        if (!e->length)
+            continue;
+        memcpy(raw, e->name, strlen(e->name));
+        memcpy(raw + 0x10, e->ext, strlen(e->ext));
+        put16(raw + 0x20, e->offset);
+        put16(raw + 0x22, e->length);
+        put32(raw + 0x24, e->crc);
+        put16(raw + 0x28, e->part);
+        put16(raw + 0x2a, e->parts);
+    }
+    dir->crc = table_crc(image);
+    put32(image + 0x0c, dir->crc);
+}
+
+int dir_find(Directory *dir, char *name, char *ext, int part)
+{
+    int i;
+
+    for (i = 0; i < DIR_ENTRIES; i++)
+    {
+        DirEntry *e = &dir->entries[i];
+        if (e->length && !strcmp(e->name, name) && !strcmp(e->ext, ext) && (!part || e->part == part))
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief in_the_way
+ *
+ * @param Directory* dir
+ * @param uint32_t start, uint32_t length - the extent to check
+ * @param int skip - an entry whose extent counts as free, -1 for none
+ * @param int mii - 1 if the Mii blocks count as free
+ *
+ * @returns the end of a wpf or reserved region the extent overlaps, or 0 if it is free
+ */
+static uint32_t in_the_way(Directory *dir, uint32_t start, uint32_t length, int skip, int mii)
+{
+    uint32_t i;
+
+    for (i = 0; i < DIR_ENTRIES; i++)
+    {
+        DirEntry *e = &dir->entries[i];
+        uint32_t end = (uint32_t)e->offset + e->length;
+        if ((int)i != skip && e->length && start < end && e->offset < start + length)
+            return end;
+    }
+    for (i = 0; i < RESERVED_REGIONS; i++)
+    {
+        const EepromRegion *r = &reserved[i];
+        if (!(mii && r->mii) && start < r->end && r->start < start + length)
+            return r->end;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief dir_place
+ *
+ * @param Directory* dir
+ * @param uint32_t length - the size of the extent
+ * @param int skip - an entry whose extent counts as free, -1 for none
+ * @param int mii - 1 if the Mii blocks count as free
+ *
+ * @returns the lowest 16 byte aligned address the extent fits at, or -1 if it fits nowhere
+ */
+static int32_t dir_place(Directory *dir, uint32_t length, int skip, int mii)
+{
+    uint32_t start = DIR_DATA_START;
+    uint32_t end;
+
+    // move past everything in the way, until nothing is
+    while ((end = in_the_way(dir, start, length, skip, mii)) != 0)
+        start = (end + 15) & ~15u;
+
+    return (start + length <= MAX_WIIMOTE_PAYLOAD) ? (int32_t)start : -1;
+}
+
+int dir_store(Directory *dir, DirEntry *entry, int in_place)
+{
+    int old        = dir_find(dir, entry->name, entry->ext, entry->part);
+    int slot       = old;
+    int32_t offset = -1;
+    int mii;
+
+    if (slot < 0)
+    {
+        for (slot = 0; slot < DIR_ENTRIES && dir->entries[slot].length; slot++)
+            ;
+        if (slot == DIR_ENTRIES)
+            return 0;
+    }
+
+    // the Mii blocks are the last resort, giving them up means moving their data off the remote
+    for (mii = dir->mii_moved; offset < 0 && mii <= 1; mii++)
+    {
+        uint32_t start = (old >= 0) ? dir->entries[old].offset : 0;
+        if (in_place && old >= 0 && start + entry->length <= MAX_WIIMOTE_PAYLOAD &&
+            !in_the_way(dir, start, entry->length, old, mii))
+            offset = (int32_t)start;
+        if (offset < 0)
+            offset = dir_place(dir, entry->length, -1, mii);
+        if (offset < 0 && old >= 0)
+            offset = dir_place(dir, entry->length, old, mii);
+    }
+    if (offset < 0)
+        return 0;
+
+    entry->offset      = (uint16_t)offset;
+    dir->entries[slot] = *entry;
+    if (holds_mii((uint32_t)offset, entry->length))
+        dir->mii_moved = 1;
+
+    return 1;
+}
+
+int dir_drop(Directory *dir, char *name, char *ext, int keep)
+{
+    int i;
+    int dropped = 0;
+
+    for (i = 0; i < DIR_ENTRIES; i++)
+    {
+        DirEntry *e = &dir->entries[i];
+        if (e->length && !strcmp(e->name, name) && !strcmp(e->ext, ext) && e->part != keep)
+        {
+            memset(e, 0, sizeof(DirEntry));
+            dropped++;
+        }
+    }
+
+    return dropped;
+}
+
+int dir_free_mii(Directory *dir)
+{
+    int i;
+    int dropped = 0;
+
+    for (i = 0; i < DIR_ENTRIES; i++)
+    {
+        DirEntry *e = &dir->entries[i];
+        if (e->length && holds_mii(e->offset, e->length))
+        {
+            memset(e, 0, sizeof(DirEntry));
+            dropped++;
+        }
+    }
+    dir->mii_moved = 0;
+
+    return dropped;
+}
@@ -0,0 +1,123 @@
+/**
+ * directory
+ *
+ * purpose: to pack several wpfs onto one remote. a small
+ *      table near the start of the eeprom lists every wpf
+ *      the remote holds, with its name, extension, address,
+ *      length and crc32, so a file is found with a single
+ *      read of the table. the wpfs sit in extents after it,
+ *      around the parts of the eeprom the remote and the Wii
+ *      keep their own data in
+ */
+#ifndef DIRECTORY_H
+#define DIRECTORY_H
+#include <stdint.h>
+
+// the user memory of the eeprom runs from 0x0000 to 0x16ff, see directory.c for what is kept where
+#define CALIBRATION_SIZE 0x2a
+#define MII_ADDR 0x0fca // the two blocks of Mii data the Wii's Mii Channel keeps on a remote
+#define MII_SIZE 0x05e0
+#define FACTORY_ADDR 0x16d0 // written before the remote shipped, what reads it isn't known
+#define MAX_WIIMOTE_PAYLOAD FACTORY_ADDR // the eeprom bytes files are kept in
+
+#define DIR_ADDR 0x30 // the remote's calibration is kept in the bytes before the table
+#define DIR_ENTRIES 6
+#define DIR_ENTRY_SIZE 0x30
+#define DIR_SIZE (0x10 + DIR_ENTRIES * DIR_ENTRY_SIZE)
+#define DIR_DATA_START (DIR_ADDR + DIR_SIZE)
+#define DIR_CAPACITY (MAX_WIIMOTE_PAYLOAD - DIR_DATA_START) // the largest wpf, once the Mii blocks are moved
+#define DIR_HEADER_SIZE 0x10 // magic, version, generation and crc32, enough to tell two tables apart
+
+typedef struct DirEntry
+{
+    char name[17];
+    char ext[17];
+    uint16_t offset; // where the wpf starts in the eeprom
+    uint16_t length; // the size of the wpf, header included. 0 for an empty entry
+    uint32_t crc;    // crc32 of the whole wpf, 0 when it isn't known
+    uint16_t part;
+    uint16_t parts;
+} DirEntry;
+
+typedef struct Directory
+{
+    DirEntry entries[DIR_ENTRIES];
+    uint32_t generation; // bumped by every upload, so a copy of the eeprom can tell it is out of date
+    uint32_t crc;        // crc32 of the table as read or last built, two of a generation can differ
+    int mii_moved;       // 1 once wpfs may take up the Mii blocks, their data is kept on the host
+    int legacy;          // 1 when the remote holds a single wpf at address 0, from before there were tables
+} Directory;
+
+/**
+ * @brief dir_parse
+ *
+ * @param char* image - the DIR_SIZE bytes read from DIR_ADDR
+ * @param Directory* dir - the directory to fill in
+ *
+ * @returns 1 if the remote has a table, 0 if it has none, in which case dir is left empty
+ */
+int dir_parse(char *image, Directory *dir);
+
+/**
+ * @brief dir_build
+ *
+ * @param Directory* dir - the directory to write out
+ * @param char* image - DIR_SIZE bytes to build the table in, for writing to DIR_ADDR
+ */
+void dir_build(Directory *dir, char *image);
+
+/**
+ * @brief dir_find
+ *
+ * @param Directory* dir
+ * @param char* name, char* ext - the file to look for
+ * @param int part - the part to look for, 0 for any
+ *
+ * @returns the index of the entry, or -1 if the remote doesn't hold it
+ */
+int dir_find(Directory *dir, char *name, char *ext, int part);
+
+/**
+ * @brief dir_store
+ *
+ * @param Directory* dir
+ * @param DirEntry* entry - the wpf to add, its offset is filled in
+ * @param int in_place - 1 to put the wpf where the one it replaces is, if it fits there
+ *
+ * @returns 1 on success, 0 if the remote has no room for it
+ *
+ * gives the wpf the first extent it fits in, replacing any wpf of the same
+ * name, extension and part. unless asked to, the one it replaces is only
+ * written over when there is no other room, so it survives an upload that
+ * is cut short. the Mii blocks are only given up when the wpf fits nowhere
+ * else, mii_moved is set once they are
+ */
+int dir_store(Directory *dir, DirEntry *entry, int in_place);
+
+/**
+ * @brief dir_drop
+ *
+ * @param Directory* dir
+ * @param char* name, char* ext - the file to drop
+ * @param int keep - a part to leave listed, 0 to drop every part
+ *
+ * @returns the number of entries dropped
+ *
+ * forgets the parts of a file an upload of a newer version
+ * of it doesn't write, so they can't be mixed in with it
+ */
+int dir_drop(Directory *dir, char *name, char *ext, int keep);
+
+/**
+ * @brief dir_free_mii
+ *
+ * @param Directory* dir
+ *
+ * @returns the number of entries dropped
+ *
+ * drops every wpf kept in the Mii blocks and clears mii_moved,
+ * so the Mii data can be written back
+ */
+int dir_free_mii(Directory *dir);
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * file_map
+ *
+ * purpose: to map files straight into memory, so
+ *      splitting a file into wpfs and stitching them
+ *      back together is done with slices of the mapped
+ *      files rather than read and write calls
+ */
+
+#include "file_map.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+/**
+ * @brief open_map
+ *
+ * @param FileMap *map, char *file_name, uint32_t size, int write
+ *
+ * @returns 1 on success, 0 on failure
+ *
+ * maps the whole file, a size of 0 maps the file at the size it already is
+ */
+static int open_map(FileMap *map, char *file_name, uint32_t size, int write)
+{
+    memset(map, 0, sizeof(FileMap));
+    map->file = CreateFileA(file_name, write ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ,
+                            NULL, write ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE)
+        return 0;
+
+    if (!size)
+        size = GetFileSize(map->file, NULL);
+    if (!size || size == INVALID_FILE_SIZE)
+    {
+        CloseHandle(map->file);
+        return 0;
+    }
+
+    // mapping a new file past its end grows it to size
+    map->mapping = CreateFileMappingA(map->file, NULL, write ? PAGE_READWRITE : PAGE_READONLY, 0, size, NULL);
+    if (!map->mapping)
+    {
+        CloseHandle(map->file);
+        return 0;
+    }
+    map->data = MapViewOfFile(map->mapping, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+    if (!map->data)
+    {
+        CloseHandle(map->mapping);
+        CloseHandle(map->file);
+        return 0;
+    }
+    map->size = size;
+
+    return 1;
+}
+
+void unmap_file(FileMap *map)
+{
+    if (!map->data)
+        return;
+    UnmapViewOfFile(map->data);
+    CloseHandle(map->mapping);
+    CloseHandle(map->file);
+    map->data = NULL;
+}
+
+#else
+
+/**
+ * @brief open_map
+ *
+ * @param FileMap *map, char *file_name, uint32_t size, int write
+ *
+ * @returns 1 on success, 0 on failure
+ *
+ * maps the whole file, a size of 0 maps the file at the size it already is
+ */
+static int open_map(FileMap *map, char *file_name, uint32_t size, int write)
+{
+    struct stat st;
+
+    memset(map, 0, sizeof(FileMap));
+    map->fd = open(file_name, write ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+    if (map->fd < 0)
+        return 0;
+
+    if (write)
+    {
+        // size the file up front, the pages are filled in through the map
+        if (ftruncate(map->fd, size))
+        {
+            close(map->fd);
+            return 0;
+        }
+    } else
+    {
+        if (fstat(map->fd, &st))
+        {
+            close(map->fd);
+            return 0;
+        }
+        size = (uint32_t)st.st_size;
+    }
+    if (!size)
+    {
+        close(map->fd);
+        return 0;
+    }
+
+    map->data = mmap(NULL, size, write ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, map->fd, 0);
+    if (map->data == MAP_FAILED)
+    {
+        map->data = NULL;
+        close(map->fd);
+        return 0;
+    }
+    map->size = size;
+
+    return 1;
+}
+
+void unmap_file(FileMap *map)
+{
+    if (!map->data)
+        return;
+    munmap(map->data, map->size);
+    close(map->fd);
+    map->data = NULL;
+}
+
+#endif
+
+int map_file(FileMap *map, char *file_name) { return open_map(map, file_name, 0, 0); }
+
+int map_new_file(FileMap *map, char *file_name, uint32_t size)
+{
+    if (!size)
+        return 0;
+    return open_map(map, file_name, size, 1);
+}
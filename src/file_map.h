@@ -0,0 +1,60 @@
+/**
+ * file_map
+ *
+ * purpose: to map files straight into memory, so
+ *      splitting a file into wpfs and stitching them
+ *      back together is done with slices of the mapped
+ *      files rather than read and write calls through
+ *      stack buffers
+ */
+#ifndef FILE_MAP_H
+#define FILE_MAP_H
+#include <stdint.h>
+
+typedef struct FileMap
+{
+    char *data;
+    uint32_t size;
+
+#ifdef _WIN32
+    void *file;    // HANDLE of the open file
+    void *mapping; // HANDLE of the file mapping
+#else
+    int fd;
+#endif
+} FileMap;
+
+/**
+ * @brief map_file
+ *
+ * @param FileMap* map - the map to fill in
+ * @param char* file_name - the file to map for reading
+ *
+ * @returns 1 on success, 0 on failure. empty files can't be mapped
+ */
+int map_file(FileMap *map, char *file_name);
+
+/**
+ * @brief map_new_file
+ *
+ * @param FileMap* map - the map to fill in
+ * @param char* file_name - the file to create, or overwrite
+ * @param uint32_t size - the size the file is made to be up front
+ *
+ * @returns 1 on success, 0 on failure
+ *
+ * creates a file of the given size and maps it for writing,
+ * everything written to map->data ends up in the file
+ */
+int map_new_file(FileMap *map, char *file_name, uint32_t size);
+
+/**
+ * @brief unmap_file
+ *
+ * @param FileMap* map - a map from map_file or map_new_file
+ *
+ * unmaps and closes the file, flushing anything written to it
+ */
+void unmap_file(FileMap *map);
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * journal
+ *
+ * purpose: to remember how far every transfer got, so an
+ *      upload or download that was cut short picks up at
+ *      the exact block it stopped at
+ */
+
+#include "journal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define JOURNAL_MAGIC 0x57504a36 // "WPJ6"
+
+int journal_load(Journal *journal)
+{
+    FILE *fp;
+    size_t read;
+
+    if (fopen_s(&fp, JOURNAL_FILE, "rb"))
+        return 0;
+    read = fread(journal, sizeof(Journal), 1, fp);
+    fclose(fp);
+
+    // a journal from another build, or one that was cut off, can't be trusted
+    if (read != 1 || journal->magic != JOURNAL_MAGIC || journal->count > MAX_WIIMOTES)
+    {
+        printf("[ERROR] %s is unreadable, starting over\n", JOURNAL_FILE);
+        return 0;
+    }
+
+    return 1;
+}
+
+void journal_save(Transfer *transfers, int count)
+{
+    Journal journal;
+    FILE *fp;
+    int i;
+
+    memset(&journal, 0, sizeof(Journal));
+    journal.magic = JOURNAL_MAGIC;
+    for (i = 0; i < count && i < MAX_WIIMOTES; i++)
+    {
+        Transfer *t = &transfers[i];
+        JournalEntry *e;
+
+        // a listing has no wpf to record, and the Mii data a restore writes is kept on disk anyway
+        if (t->state == TRANSFER_INVALID || t->listing || t->restore || !t->size)
+            continue;
+
+        e = &journal.entries[journal.count++];
+        strcpy(e->remote_addr, t->remote_addr);
+        strcpy(e->wpf_name, t->wpf_name);
+        e->upload = (uint8_t)t->upload;
+        e->base   = t->base;
+        e->size   = t->size;
+        e->crc    = t->crc;
+        memcpy(e->blocks, t->blocks, TRANSFER_BLOCK_BYTES);
+
+        // the received blocks have to survive as well, the bitmap says which are good
+        if (!t->upload)
+            memcpy(e->data, t->buffer, t->size);
+    }
+
+    // the directories are read before anything else, that mustn't wipe the journal of the run being resumed
+    if (!journal.count)
+        return;
+
+    if (fopen_s(&fp, JOURNAL_FILE, "wb"))
+    {
+        printf("\n[ERROR] Could not write %s\n", JOURNAL_FILE);
+        return;
+    }
+    fwrite(&journal, sizeof(Journal), 1, fp);
+    fclose(fp);
+}
+
+void journal_clear() { remove(JOURNAL_FILE); }
+
+JournalEntry *journal_find(Journal *journal, int upload, char *remote_addr, char *wpf_name)
+{
+    uint32_t i;
+
+    if (!journal)
+        return NULL;
+    for (i = 0; i < journal->count; i++)
+    {
+        JournalEntry *e = &journal->entries[i];
+        if (e->upload != upload)
+            continue;
+        if (remote_addr && strcmp(e->remote_addr, remote_addr))
+            continue;
+        if (wpf_name && strcmp(e->wpf_name, wpf_name))
+            continue;
+        return e;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,78 @@
+/**
+ * journal
+ *
+ * purpose: to remember how far every transfer got, so an
+ *      upload or download that was cut short picks up at
+ *      the exact block it stopped at. the journal is saved
+ *      to disk while transfers run, and lists each remote's
+ *      address, the wpf it was moving, and which 16 byte
+ *      blocks of that wpf are already done
+ */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+#include <stdint.h>
+
+#include "transfer.h"
+
+#define JOURNAL_FILE "transfer.journal"
+
+typedef struct JournalEntry
+{
+    char remote_addr[18]; // the remote the wpf was going to or coming from
+    char wpf_name[WPF_NAME_SIZE];
+    uint8_t upload;
+    uint32_t base; // where the wpf is in the eeprom
+    uint32_t size;
+    uint32_t crc; // crc32 of the whole wpf, only the same contents pick up where it left off
+    uint8_t blocks[TRANSFER_BLOCK_BYTES];
+    char data[MAX_WIIMOTE_PAYLOAD]; // what a download has received so far, blocks says which are good
+} JournalEntry;
+
+typedef struct Journal
+{
+    uint32_t magic;
+    uint32_t count;
+    JournalEntry entries[MAX_WIIMOTES];
+} Journal;
+
+/**
+ * @brief journal_load
+ *
+ * @param Journal* journal - the journal to fill in
+ *
+ * @returns 1 if a journal was left behind, 0 if there is nothing to resume
+ */
+int journal_load(Journal *journal);
+
+/**
+ * @brief journal_save
+ *
+ * @param Transfer* transfers - the transfers being run
+ * @param int count - the number of transfers
+ *
+ * records the progress of every transfer, downloads also keep
+ * what they have received so far in the journal itself. the journal
+ * on disk is left as it is when there is nothing to record
+ */
+void journal_save(Transfer *transfers, int count);
+
+/**
+ * @brief journal_clear
+ *
+ * removes the journal once everything it covered is finished
+ */
+void journal_clear();
+
+/**
+ * @brief journal_find
+ *
+ * @param Journal* journal - a loaded journal, may be NULL
+ * @param int upload - 1 to look for an upload, 0 for a download
+ * @param char* remote_addr - the remote to look for, NULL to match any
+ * @param char* wpf_name - the wpf to look for, NULL to match any
+ *
+ * @returns the matching entry, or NULL if there is none
+ */
+JournalEntry *journal_find(Journal *journal, int upload, char *remote_addr, char *wpf_name);
+
+#endif
@@ -0,0 +1,137 @@
+/**
+ * lz
+ *
+ * purpose: to shrink wpf payloads before they are split
+ *      across remotes
+ */
+
+#include "lz.h"
+
+#include <string.h>
+
+#define LZ_WINDOW 4096 // how far back a match can start
+#define LZ_MIN_MATCH 3 // shorter matches cost more than the literals
+#define LZ_MAX_MATCH 18
+#define LZ_HASH_SIZE 4096
+#define LZ_MAX_CHAIN 64 // candidates checked per byte, trades ratio for speed
+
+/**
+ * @brief lz_hash
+ *
+ * @param uint8_t *p
+ *
+ * @returns the hash chain the 3 bytes at p belong to
+ */
+static uint32_t lz_hash(uint8_t *p) { return ((p[0] << 4) ^ (p[1] << 2) ^ p[2]) & (LZ_HASH_SIZE - 1); }
+
+uint32_t lz_compress(uint8_t *in, uint32_t in_size, uint8_t *out, uint32_t out_cap)
+{
+    // the most recent position of every hash, and the one before each position
+    static int32_t head[LZ_HASH_SIZE];
+    static int32_t prev[LZ_WINDOW];
+    uint32_t pos = 0, out_pos = 0, flag_pos = 0;
+    int items = 8;
+
+    memset(head, -1, sizeof(head));
+    while (pos < in_size)
+    {
+        uint32_t best_len = 0, best_off = 0;
+        uint32_t step, i;
+
+        // every 8 items gets a new flag byte
+        if (items == 8)
+        {
+            if (out_pos >= out_cap)
+                return 0;
+            flag_pos      = out_pos++;
+            out[flag_pos] = 0;
+            items         = 0;
+        }
+
+        if (pos + LZ_MIN_MATCH <= in_size)
+        {
+            int32_t cand = head[lz_hash(in + pos)];
+            int chain    = LZ_MAX_CHAIN;
+            while (cand >= 0 && pos - cand <= LZ_WINDOW && chain--)
+            {
+                uint32_t len = 0;
+                while (len < LZ_MAX_MATCH && pos + len < in_size && in[cand + len] == in[pos + len])
+                    len++;
+                if (len > best_len)
+                {
+                    best_len = len;
+                    best_off = pos - cand;
+                    if (len == LZ_MAX_MATCH)
+                        break;
+                }
+                cand = prev[cand % LZ_WINDOW];
+            }
+        }
+
+        if (best_len >= LZ_MIN_MATCH)
+        {
+            if (out_pos + 2 > out_cap)
+                return 0;
+            out[flag_pos] |= (1 << items);
+            out[out_pos++] = (uint8_t)(((best_off - 1) >> 4) & 0xff);
+            out[out_pos++] = (uint8_t)((((best_off - 1) & 0x0f) << 4) | (best_len - LZ_MIN_MATCH));
+            step           = best_len;
+        } else
+        {
+            if (out_pos >= out_cap)
+                return 0;
+            out[out_pos++] = in[pos];
+            step           = 1;
+        }
+        items++;
+
+        // every byte passed over can be matched against later
+        for (i = 0; i < step; i++, pos++)
+        {
+            if (pos + LZ_MIN_MATCH <= in_size)
+            {
+                uint32_t h            = lz_hash(in + pos);
+                prev[pos % LZ_WINDOW] = head[h];
+                head[h]               = (int32_t)pos;
+            }
+        }
+    }
+
+    return out_pos;
+}
+
+uint32_t lz_decompress(uint8_t *in, uint32_t in_size, uint8_t *out, uint32_t out_cap)
+{
+    uint32_t pos = 0, out_pos = 0;
+
+    while (pos < in_size)
+    {
+        uint8_t flags = in[pos++];
+        int items;
+
+        for (items = 0; items < 8 && pos < in_size; items++)
+        {
+            if (flags & (1 << items))
+            {
+                uint32_t off, len, i;
+                if (pos + 2 > in_size)
+                    return 0;
+                off = ((in[pos] << 4) | (in[pos + 1] >> 4)) + 1;
+                len = (in[pos + 1] & 0x0f) + LZ_MIN_MATCH;
+                pos += 2;
+                if (off > out_pos || out_pos + len > out_cap)
+                    return 0;
+                // matches can overlap what they are copying, so go a byte at a time
+                for (i = 0; i < len; i++, out_pos++)
+                    out[out_pos] = out[out_pos - off];
+            } else
+            {
+                if (out_pos >= out_cap)
+                    return 0;
+                out[out_pos++] = in[pos++];
+            }
+        }
+    }
+
+    return out_pos;
+}
@@ -0,0 +1,38 @@
+/**
+ * lz
+ *
+ * purpose: to shrink wpf payloads before they are split
+ *      across remotes. a small LZ77 variant, every group
+ *      of 8 items starts with a flag byte, a 0 bit is a
+ *      literal byte and a 1 bit is a 2 byte match of
+ *      3 to 18 bytes up to 4096 bytes back
+ */
+#ifndef LZ_H
+#define LZ_H
+#include <stdint.h>
+
+/**
+ * @brief lz_compress
+ *
+ * @param uint8_t* in - the data to compress
+ * @param uint32_t in_size - the size of the data
+ * @param uint8_t* out - where the compressed data is written
+ * @param uint32_t out_cap - the most out can hold
+ *
+ * @returns the compressed size, 0 if it did not fit in out_cap
+ */
+uint32_t lz_compress(uint8_t *in, uint32_t in_size, uint8_t *out, uint32_t out_cap);
+
+/**
+ * @brief lz_decompress
+ *
+ * @param uint8_t* in - the compressed data
+ * @param uint32_t in_size - the size of the compressed data
+ * @param uint8_t* out - where the original data is written
+ * @param uint32_t out_cap - the most out can hold
+ *
+ * @returns the original size, 0 if the data is corrupted or too big for out
+ */
+uint32_t lz_decompress(uint8_t *in, uint32_t in_size, uint8_t *out, uint32_t out_cap);
+
+#endif
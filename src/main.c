@@ -1,104 +1,30 @@
 #include <stdio.h> /* for printf */
 #include <stdlib.h>
-#include <time.h> /* for timing downloads */
+#include <string.h> /* for strcpy */
 
 #include "wiiuse.h" /* for wiimote_t, classic_ctrl_t, etc */
 #include "io.h"
 
+#include "file_map.h"
+#include "journal.h"
+#include "rs.h"
+#include "transfer.h"
 #include "wpf_handler.h"
 
 #ifndef WIIUSE_WIN32
 #include <unistd.h> /* for usleep */
 #endif
 
-#define MAX_WIIMOTES 2
-#define MAX_WIIMOTE_PAYLOAD 5360
+#define STAGE_ARG "-s"                         // keep .wpf files on disk
+#define PARITY_ARG "-p"                        // stripe the file with parity parts
+#define DOWNLOAD_ARG "-d"                      // download a file by name
+#define LIST_ARG "-l"                          // list the files on every remote
+#define DELTA_ARG "-u"                         // upload over the old version, writing only what changed
+#define MII_ARG "-m"                           // put the Mii data uploads moved off the remotes back
+#define KNOWN_REMOTES_FILE "known_remotes.txt" // addresses of the remotes from the last connection
 
-// holds the size of our payload we expect
+// holds the size of the file we were asked to upload
 uint32_t payload_size = 0;
-// holds how much of the payload we've gotten
-uint32_t payload_received = 0;
-// leds of the wiimote
-int leds = 0x00;
-// the total num of wiimotes for a download
-int tot_wiimotes = 0;
-// current wiimote
-int cur_wiimote = 0;
-
-typedef struct header
-{
-    uint32_t file_size;
-    uint32_t file_size_on_remote;
-    uint16_t total_remotes;
-    uint16_t curr_remote_num;
-} header;
-
-void print_progress(wiimote *remote, char *title, float rec, float tot)
-{
-    char completed[51];
-    // update progress bar
-    float p = rec / tot;
-    int i   = 0;
-    char a = 177, b = 219;
-    do
-    {
-        completed[i] = (i < (50.0 * p)) ? b : a;
-    } while (++i < 50.0);
-    completed[i] = '\0';
-
-    // update LEDS
-    if (p <= 0.25)
-    {
-        leds = 0x00;
-        wiiuse_set_leds(remote, leds);
-    } else if (p <= 0.5)
-    {
-        leds = (1 << 4);
-        wiiuse_set_leds(remote, leds);
-    } else if (p <= 0.75)
-    {
-        leds = (1 << 5) | (1 << 4);
-        wiiuse_set_leds(remote, leds);
-    } else
-    {
-        leds = (1 << 6) | (1 << 5) | (1 << 4);
-        wiiuse_set_leds(remote, leds);
-    }
-
-    printf("%s [%s]     %4dB / %4dB\r", title, completed, payload_received, payload_size);
-}
-
-void alert_remote(wiimote *remote)
-{
-    wiiuse_set_leds(remote, 0xF0);
-    wiiuse_toggle_rumble(remote);
-    Sleep(175);
-    wiiuse_set_leds(remote, 0x00);
-    wiiuse_toggle_rumble(remote);
-    Sleep(50);
-    wiiuse_toggle_rumble(remote);
-    Sleep(200);
-    wiiuse_set_leds(remote, 0xF0);
-    wiiuse_toggle_rumble(remote);
-}
-
-uint16_t convert_to_uint16(uint8_t *p_value)
-{
-    uint32_t least_sig       = (0x0000 | p_value[1]);
-    uint32_t most_sig        = (0x0000 | p_value[0]) << 8;
-    uint32_t converted_value = least_sig | most_sig;
-    return converted_value;
-}
-
-uint32_t convert_to_uint32(uint8_t *p_value)
-{
-    uint32_t least_sig        = (0x00000000 | p_value[3]);
-    uint32_t second_least_sig = (0x00000000 | p_value[2]) << 8;
-    uint32_t second_most_sig  = (0x00000000 | p_value[1]) << 16;
-    uint32_t most_sig         = (0x00000000 | p_value[0]) << 24;
-    uint32_t converted_value  = (least_sig | second_least_sig) | (second_most_sig | most_sig);
-    return converted_value;
-}
 
 int32_t findSize(char *file_name)
 {
@@ -143,341 +69,633 @@ short any_wiimote_connected(wiimote **wm, int wiimotes)
     return 0;
 }
 
+/**
+ * @brief load_known_remotes
+ *
+ * @param char addrs[][18] - MAX_WIIMOTES addresses to fill in
+ *
+ * @returns the number of remotes that were connected last time
+ */
+int load_known_remotes(char addrs[][18])
+{
+    FILE *fp;
+    int known = 0;
+
+    if (fopen_s(&fp, KNOWN_REMOTES_FILE, "r"))
+        return 0;
+    while (known < MAX_WIIMOTES && fscanf(fp, "%17s", addrs[known]) == 1)
+        known++;
+    fclose(fp);
+
+    return known;
+}
+
+/**
+ * @brief save_known_remotes
+ *
+ * @param wiimote** wiimotes - the remotes that were just connected
+ *
+ * remembers the address of every connected remote, in order
+ */
+void save_known_remotes(wiimote **wiimotes)
+{
+    FILE *fp;
+    char addr[18];
+    int i;
+
+    if (fopen_s(&fp, KNOWN_REMOTES_FILE, "w"))
+        return;
+    for (i = 0; i < MAX_WIIMOTES; i++)
+    {
+        if (!WIIMOTE_IS_CONNECTED(wiimotes[i]))
+            continue;
+        remote_address(wiimotes[i], addr);
+        fprintf(fp, "%s\n", addr);
+    }
+    fclose(fp);
+}
+
 wiimote **connect_remotes()
 {
-    int found, connected;
+    int found = 0, connected = 0, known, i;
+    char addrs[MAX_WIIMOTES][18];
 
     wiimote **wiimotes = wiiuse_init(MAX_WIIMOTES);
-    found              = wiiuse_find(wiimotes, MAX_WIIMOTES, 5);
-    if (!found)
+
+    // remotes seen before are connected to directly, that takes no inquiry
+    known = load_known_remotes(addrs);
+    for (i = 0; i < known; i++)
+        connected += wiiuse_connect_address(wiimotes[connected], addrs[i]);
+
+    // only search when a remote we know of didn't answer
+    if (!known || connected < known)
     {
-        printf("No wiimotes found.\n");
-        return 0;
+        found = wiiuse_find(wiimotes + connected, MAX_WIIMOTES - connected, 5);
+        if (found)
+            connected += wiiuse_connect(wiimotes + connected, MAX_WIIMOTES - connected);
     }
-    connected = wiiuse_connect(wiimotes, MAX_WIIMOTES);
+    found += known;
+
     if (connected)
     {
         printf("Connected to %i wiimotes (of %i found).\n", connected, found);
+    } else if (!found)
+    {
+        printf("No wiimotes found.\n");
+        return 0;
     } else
     {
         printf("Failed to connect to any wiimote.\n");
         return 0;
     }
+    save_known_remotes(wiimotes);
 
     return wiimotes;
 }
 
-int read_from_wiimote(wiimote *remote, char *buffer, unsigned int address)
+/**
+ * @brief reattach_transfers
+ *
+ * @param wiimote** wiimotes - the freshly connected remotes
+ * @param Transfer* transfers - the transfers that were running
+ * @param int count - the number of transfers
+ *
+ * @returns 1 if every failed transfer was resumed, 0 if the remote one was talking to is missing
+ *
+ * hands every transfer the remote it was talking to before,
+ * and resumes the ones that failed. what a transfer knows of
+ * the eeprom belongs to its own remote, so a transfer whose
+ * remote didn't come back is never handed another one
+ */
+int reattach_transfers(wiimote **wiimotes, Transfer *transfers, int count)
 {
-    time_t start = time(NULL);
-    wiiuse_read_data_sync(remote, 0x01, address, 16, buffer);
-    time_t end = time(NULL);
-    Sleep(1);
-
-    if (end - start >= 5)
+    int i, resumed = 1;
+    for (i = 0; i < count; i++)
     {
-        printf("\n[ERROR] Process timed out. Restarting soon...\n");
-        return -1;
-    }
+        Transfer *t     = &transfers[i];
+        wiimote *remote = find_remote(wiimotes, MAX_WIIMOTES, t->remote_addr);
 
-    return 1;
-}
+        if (remote)
+        {
+            if (t->state == TRANSFER_FAILED)
+                resume_transfer(t, remote);
+            else
+                t->remote = remote;
+            continue;
+        }
 
-int write_to_wiimote(wiimote *remote, char *buffer, unsigned int address)
-{
-    int res = wiiuse_write_data(remote, address, buffer, 16);
+        // the old remote is gone, the transfer keeps a connected one to be polled with but never uses it
+        t->remote = wiimotes[i];
+        if (t->state == TRANSFER_FAILED)
+        {
+            printf("[ERROR] Remote %s did not reconnect, %s is left where it stopped\n", t->remote_addr,
+                   (t->listing || !t->size) ? "its directory" : t->wpf_name);
+            resumed = 0;
+        } else if (t->listing)
+        {
+            // the directory read describes a remote that isn't there
+            t->state = TRANSFER_INVALID;
+        }
+    }
 
-    return 1;
+    return resumed;
 }
 
-int compare_buffers(char *buf1, char *buf2)
+/**
+ * @brief list_remotes
+ *
+ * @param wiimote** wiimotes - the connected remotes
+ * @param Transfer* listings - MAX_WIIMOTES transfers to read the directories into
+ *
+ * @returns the remotes, reconnected if they had to be, or NULL once none are left
+ */
+wiimote **list_remotes(wiimote **wiimotes, Transfer *listings)
 {
-    int i = 0;
-    while (i < 16)
+    int i, missing = 0;
+
+    for (i = 0; i < MAX_WIIMOTES; i++)
+        init_listing(&listings[i], wiimotes[i]);
+    while (run_transfers(listings, MAX_WIIMOTES))
     {
-        // they are different! EXIT
-        if (buf1[i] != buf2[i])
-        {
-            return 0;
-        }
-        i++;
+        int failed = 0;
+        for (i = 0; i < MAX_WIIMOTES; i++)
+            failed += (listings[i].state == TRANSFER_FAILED);
+        if (!failed || missing)
+            break;
+
+        wiiuse_cleanup(wiimotes, MAX_WIIMOTES);
+        wiimotes = connect_remotes();
+        printf("\n");
+        if (!any_wiimote_connected(wiimotes, MAX_WIIMOTES))
+            return NULL;
+        missing = !reattach_transfers(wiimotes, listings, MAX_WIIMOTES);
     }
 
-    return 1;
+    return wiimotes;
 }
 
-int validate_upload(wiimote *remote, char *buffer1, char *buffer2, int address)
+/**
+ * @brief directory_of
+ *
+ * @param Transfer* listings - the listings from list_remotes
+ * @param wiimote* remote
+ *
+ * @returns the directory of the remote, or NULL if it couldn't be read
+ */
+Directory *directory_of(Transfer *listings, wiimote *remote)
 {
-    int failures = 0;
-    // printf("\nADDRESS: %x\nSNT: ", address);
-    // int i = 0;
-    // while (i < 16)
-    // {
-    //     printf("%2x ", buffer1[i++]);
-    // }
-    // printf("\n");
-
-    do
-    {
-        write_to_wiimote(remote, buffer1, address);
-        if (read_from_wiimote(remote, buffer2, address) == -1)
-            return -1;
-    } while (!compare_buffers(buffer1, buffer2) && failures++ < 10);
-    // this will occur if matches SUCK or keep sucking
-    if (failures >= 10)
-    {
-        printf("\n[ERROR] Upload timed out. Restarting soon...\n");
-        return -1;
+    int i;
+    for (i = 0; i < MAX_WIIMOTES; i++)
+    {
+        if (listings[i].remote == remote && listings[i].state == TRANSFER_DONE)
+            return &listings[i].dir;
     }
 
-    return 1;
+    return NULL;
 }
 
-int write_file(wiimote *remote, char *buffer, char *file_name, int address, FILE *fp, int restarted)
+/**
+ * @brief place_part
+ *
+ * @param Transfer* t - the transfer to set up
+ * @param wiimote* remote - the remote to try
+ * @param WiimotePartialFile* wpf - prepared with prepare_data, cur_wpf picks the part
+ * @param Transfer* listings - the listings from list_remotes
+ * @param JournalEntry* entry - the journaled progress of this part, may be NULL
+ * @param int delta - 1 to write over the part's older version, only where it differs
+ *
+ * @returns 1 if the remote has room for the part and its upload is set up, 0 if not
+ */
+int place_part(Transfer *t, wiimote *remote, WiimotePartialFile *wpf, Transfer *listings, JournalEntry *entry,
+               int delta)
 {
-    char *buf_ptr = buffer;
-    char check_buf[16]; // used to redownload and check state
-    int res = findSize(file_name);
-    buf_ptr += address;
-
-    int i = 0;
-    // upload the rest of the file
-    while (payload_received < payload_size)
-    {
-        // only read the file if we ARENT restarting the download
-        while (i++ < 16 && !restarted)
-            fread(buf_ptr++, 1, sizeof(char), fp);
-        // if we hit 16, reset everything
-        if (validate_upload(remote, buffer, check_buf, address) == -1)
-            return address;
-
-        // reset vals
-        restarted = 0; // if we successfully upload, and we restarted a upload, set restarted to false
-        i         = 0;
-        buf_ptr   = buffer;
-        address += 0x10;
-        payload_received += 16;
-
-        // print progress, continue reading file
-        print_progress(remote, "UPLOAD PROGRESS:", (float)payload_received, (float)payload_size);
-    }
-    payload_received = payload_size;
-    print_progress(remote, "UPLOAD PROGRESS:", (float)payload_received, (float)payload_size);
-
-    // close file and alert user
-    fclose(fp);
-    alert_remote(remote);
-
-    return -1;
+    Directory *dir = directory_of(listings, remote);
+    return dir && init_upload(t, remote, wpf, dir, entry, delta);
 }
 
-void handle_upload_request(wiimote **wiimotes, char *file_name, WiimotePartialFile *wpf)
+void handle_list_request(wiimote **wiimotes)
 {
-    int address = 0;        // result from an operation
-    FILE *fp;               // the file we are reading/writing to
-    char buffer[16];        // used to hold data received/sent
-    int restarted_task = 0; // set if we ever fail a task
-    // setup wpf
-    char wpf_name[39];
-
-    // set up metadata
-    create_wpf_files(file_name, wpf);
-    wpf->cur_wpf = 1;
-    generate_wpf_file_name(wpf_name, wpf);
-    fopen_s(&fp, wpf_name, "rb");
-    printf("[INFO] Creating and uploading %s to remote %d\n", wpf_name, wpf->cur_wpf);
-
-    do
-    {
-        address = write_file(wiimotes[wpf->cur_wpf - 1], buffer, wpf_name, address, fp, restarted_task);
-
-        // handle resulting output
-        if (address == -1)
-        {
-            // we finished writing wpf file, now we download it!
-            printf("\n[INFO] Removing %s\n", wpf_name);
-            remove(wpf_name);
-            // move up a wpf
-            wpf->cur_wpf++;
-            if (wpf->cur_wpf > wpf->tot_wpf)
-            {
-                printf("[INFO] All wpf's written. Cleaning up.\n");
-                break;
-            }
-            // open the next wpf
-            generate_wpf_file_name(wpf_name, wpf);
-            payload_received = 0;
-            address          = 0;
-            restarted_task   = 0;
-            printf("[INFO] Creating and uploading %s to remote %d\n", wpf_name, wpf->cur_wpf);
-            fopen_s(&fp, wpf_name, "rb");
-        } else if (address >= 0)
+    Transfer listings[MAX_WIIMOTES];
+    int i, e, files = 0;
+
+    wiimotes = list_remotes(wiimotes, listings);
+    if (!wiimotes)
+        return;
+    for (i = 0; i < MAX_WIIMOTES; i++)
+    {
+        Transfer *l = &listings[i];
+        if (l->state != TRANSFER_DONE)
+            continue;
+        for (e = 0; e < DIR_ENTRIES; e++)
         {
-            // this prepares to call the method to restart at a specific point
-            restarted_task = 1;
-            // completely restart the app
-            wiiuse_cleanup(wiimotes, MAX_WIIMOTES);
-            wiimotes = connect_remotes();
-            printf("\n");
+            DirEntry *entry = &l->dir.entries[e];
+            if (!entry->length)
+                continue;
+            printf("Remote %d: %s%s%s, part %d of %d, %dB\n", l->remote->unid, entry->name,
+                   entry->ext[0] ? "." : "", entry->ext, entry->part, entry->parts, entry->length);
+            files++;
         }
-    } while (any_wiimote_connected(wiimotes, MAX_WIIMOTES) && address != -2);
+        if (l->dir.mii_moved)
+            printf("Remote %d: files take up its Mii blocks\n", l->remote->unid);
+    }
+    if (!files)
+        printf("[INFO] No remote holds a file\n");
 }
 
-int download_header(wiimote *remote, char *buffer, char *file_name, WiimotePartialFile *wpf)
+void handle_upload_request(wiimote **wiimotes, char *file_name, WiimotePartialFile *wpf, int parity,
+                           int delta)
 {
-    char *file_pos = buffer;
-    char read_buf[16];
+    Transfer transfers[MAX_WIIMOTES]; // one wpf per remote
+    Transfer listings[MAX_WIIMOTES];  // what every remote holds already
+    int used[MAX_WIIMOTES] = {0};
+    char wpf_name[WPF_NAME_SIZE];
+    Journal journal;
+    Journal *last_run = journal_load(&journal) ? &journal : NULL;
+    FileMap source;
+    int i, j, count, missing = 0;
+
+    // set up metadata, the wpfs are built straight into the transfers
+    if (!map_file(&source, file_name))
+    {
+        printf("[ERROR] Could not open file %s for reading\n", file_name);
+        return;
+    }
+    if (!prepare_data(file_name, source.data, source.size, wpf))
+    {
+        unmap_file(&source);
+        return;
+    }
+    if (parity && !stripe_data(wpf, parity))
+    {
+        release_data(wpf);
+        unmap_file(&source);
+        return;
+    }
+    if (wpf->tot_wpf > MAX_WIIMOTES)
+    {
+        printf("[ERROR] %s needs %d remotes, only %d can be connected\n", file_name, wpf->tot_wpf,
+               MAX_WIIMOTES);
+        release_data(wpf);
+        unmap_file(&source);
+        return;
+    }
 
-    printf("[INFO] Estimating size...\n");
-    if (read_from_wiimote(remote, file_pos, 0x00) == -1)
-        return -1;
+    // the new parts go in next to what the remotes hold
+    wiimotes = list_remotes(wiimotes, listings);
+    if (!wiimotes)
+    {
+        release_data(wpf);
+        unmap_file(&source);
+        return;
+    }
+    for (i = 0; i < wpf->tot_wpf; i++)
+    {
+        JournalEntry *entry;
+        wiimote *remote = NULL;
+
+        wpf->cur_wpf = i + 1;
+        generate_wpf_file_name(wpf_name, wpf);
+
+        // a part that was partly written goes back to the same remote
+        entry = journal_find(last_run, 1, NULL, wpf_name);
+        if (entry)
+            remote = find_remote(wiimotes, MAX_WIIMOTES, entry->remote_addr);
+        for (j = 0; j < MAX_WIIMOTES && wiimotes[j] != remote; j++)
+            ;
+        if (j < MAX_WIIMOTES &&
+            (used[j] || !place_part(&transfers[i], wiimotes[j], wpf, listings, entry, delta)))
+            j = MAX_WIIMOTES;
+
+        // then to a remote holding a copy of it, which needs nothing written,
+        // or an older version, which is replaced
+        if (j == MAX_WIIMOTES)
+        {
+            for (j = 0; j < MAX_WIIMOTES; j++)
+            {
+                Directory *dir = directory_of(listings, wiimotes[j]);
+                if (!used[j] && dir && !dir->legacy &&
+                    dir_find(dir, wpf->file_name, wpf->file_ext, i + 1) >= 0 &&
+                    place_part(&transfers[i], wiimotes[j], wpf, listings, NULL, delta))
+                    break;
+            }
+        }
 
-    header *ret = (header *)file_pos; // reads header info
-    // set nums
-    payload_size     = convert_to_uint32((uint8_t *)&(ret->file_size_on_remote));
-    tot_wiimotes     = convert_to_uint16((uint8_t *)&(ret->total_remotes));
-    wpf->tot_wpf     = tot_wiimotes;
-    cur_wiimote      = convert_to_uint16((uint8_t *)&(ret->curr_remote_num));
-    payload_received = 0;
-    // exit if corrupted
-    if (payload_size <= 0 || payload_size > MAX_WIIMOTE_PAYLOAD)
-    {
-        printf("[ERROR] Download size of %dB is invalid\n", payload_size);
-        return -1;
+        // the rest go to the first remote with room for them
+        if (j == MAX_WIIMOTES)
+        {
+            for (j = 0; j < MAX_WIIMOTES; j++)
+            {
+                if (!used[j] && place_part(&transfers[i], wiimotes[j], wpf, listings, NULL, delta))
+                    break;
+            }
+        }
+        if (j == MAX_WIIMOTES)
+        {
+            printf("[ERROR] No connected remote has room for %s\n", wpf_name);
+            release_data(wpf);
+            unmap_file(&source);
+            return;
+        }
+        used[j] = 1;
+        if (transfers[i].state != TRANSFER_DONE)
+            printf("[INFO] Uploading %s to remote %d\n", wpf_name, wiimotes[j]->unid);
     }
-    file_pos += 16;
+    release_data(wpf);
+    unmap_file(&source);
 
-    Sleep(1); // read file NAME
-    if (read_from_wiimote(remote, read_buf, 0x10) == -1)
-        return -1;
+    // the remotes left out still list parts of an older version, a download could mix them in
+    count = wpf->tot_wpf;
+    for (j = 0; j < MAX_WIIMOTES; j++)
+    {
+        Directory *dir = directory_of(listings, wiimotes[j]);
+        if (!used[j] && dir && init_drop(&transfers[count], wiimotes[j], dir, wpf->file_name, wpf->file_ext))
+            count++;
+    }
 
-    int i = 0;
-    while (i < 16 && read_buf[i] != -52)
+    // every remote writes its part at the same time
+    while (run_transfers(transfers, count))
     {
-        wpf->file_name[i] = read_buf[i];
-        file_pos[i]       = read_buf[i];
-        i++;
+        int failed = 0, invalid = 0;
+        for (i = 0; i < count; i++)
+        {
+            failed += (transfers[i].state == TRANSFER_FAILED);
+            if (transfers[i].state == TRANSFER_INVALID)
+            {
+                printf("[ERROR] %s could not be written to remote %d\n", transfers[i].wpf_name,
+                       transfers[i].remote->unid);
+                invalid++;
+            }
+        }
+        // reconnecting won't help those, the journal keeps what the others got done
+        if (invalid || !failed || missing)
+            return;
+
+        // completely restart the app, failed transfers pick up again at their address
+        wiiuse_cleanup(wiimotes, MAX_WIIMOTES);
+        wiimotes = connect_remotes();
+        printf("\n");
+        if (!any_wiimote_connected(wiimotes, MAX_WIIMOTES))
+            return;
+        missing = !reattach_transfers(wiimotes, transfers, count);
     }
-    wpf->file_name[i] = 0;
-    file_pos += 16;
 
-    Sleep(1); // read file EXTENSION
-    if (read_from_wiimote(remote, read_buf, 0x20) == -1)
-        return -1;
+    journal_clear();
+    printf("[INFO] All wpf's written. Cleaning up.\n");
+}
 
-    i = 0;
-    while (i < 16 && file_pos[i] != -52)
+void handle_restore_request(wiimote **wiimotes)
+{
+    Transfer transfers[MAX_WIIMOTES]; // one restore per remote
+    Transfer listings[MAX_WIIMOTES];  // which remotes gave up their Mii blocks
+    int i, count = 0, missing = 0;
+
+    wiimotes = list_remotes(wiimotes, listings);
+    if (!wiimotes)
+        return;
+    for (i = 0; i < MAX_WIIMOTES; i++)
     {
-        wpf->file_ext[i] = read_buf[i];
-        file_pos[i]      = read_buf[i];
-        i++;
+        Transfer *l = &listings[i];
+        if (l->state == TRANSFER_DONE && init_restore(&transfers[count], l->remote, &l->dir))
+            count++;
+    }
+    if (!count)
+    {
+        printf("[INFO] No remote has Mii data kept on this host\n");
+        return;
     }
-    wpf->file_ext[i] = 0;
-    file_pos += 16;
-    Sleep(1);
 
-    sprintf_s(file_name, 39, "%s%s%d.wpf", wpf->file_name, wpf->file_ext, cur_wiimote);
-    printf("[INFO] File found: %s\n", file_name);
-    printf("[INFO] Beginning download. Total size is %dB\n", payload_size);
+    while (run_transfers(transfers, count))
+    {
+        int failed = 0, invalid = 0;
+        for (i = 0; i < count; i++)
+        {
+            failed += (transfers[i].state == TRANSFER_FAILED);
+            if (transfers[i].state == TRANSFER_INVALID)
+            {
+                printf("[ERROR] Mii data could not be restored to remote %d\n", transfers[i].remote->unid);
+                invalid++;
+            }
+        }
+        if (invalid || !failed || missing)
+            return;
+
+        wiiuse_cleanup(wiimotes, MAX_WIIMOTES);
+        wiimotes = connect_remotes();
+        printf("\n");
+        if (!any_wiimote_connected(wiimotes, MAX_WIIMOTES))
+            return;
+        missing = !reattach_transfers(wiimotes, transfers, count);
+    }
 
-    return 1;
+    // the remotes hold their Mii data again, the copies on disk are done with
+    for (i = 0; i < count; i++)
+        remove(transfers[i].wpf_name);
+    printf("[INFO] Mii data restored\n");
 }
 
 /**
- * @brief download_file
+ * @brief pick_file
  *
- * @param wiimote *remote, char *file_buffer, char *file_name, int address
+ * @param Transfer* listings - the listings from list_remotes
+ * @param WiimotePartialFile* wpf - the name and extension of the file to download, empty for any
  *
- * Downloads a single file on a given remote
+ * @returns 1 if a remote holds the file, 0 if none does. an empty name is
+ *      filled in with the first file any remote lists
  */
-int download_file(wiimote *remote, char *file_buffer, char *file_name, int address, WiimotePartialFile *wpf)
+int pick_file(Transfer *listings, WiimotePartialFile *wpf)
 {
-    char *file_pos = file_buffer;
+    int i, e;
 
-    // get header data
-    if (address < 0x30)
+    for (i = 0; i < MAX_WIIMOTES; i++)
     {
-        switch (download_header(remote, file_pos, file_name, wpf))
+        Transfer *l = &listings[i];
+        if (l->state != TRANSFER_DONE)
+            continue;
+        for (e = 0; e < DIR_ENTRIES; e++)
         {
-        case 1:
-            print_progress(remote, "DATA DOWNLOADED:", (float)payload_received, (float)payload_size);
-            address = 0x30; // success! continue
-            file_pos += 0x30;
-            break;
-        case -1:
-            return 0x00; // timed out
-        case -2:
-            return -2; // invalid header
+            DirEntry *entry = &l->dir.entries[e];
+            if (!entry->length)
+                continue;
+            if (!wpf->file_name[0] && !wpf->file_ext[0])
+            {
+                strcpy(wpf->file_name, entry->name);
+                strcpy(wpf->file_ext, entry->ext);
+            }
+            if (!strcmp(wpf->file_name, entry->name) && !strcmp(wpf->file_ext, entry->ext))
+                return 1;
         }
-    } else
-    {
-        printf("[INFO] Resuming download. %dB out of %dB\n", payload_received, payload_size);
-        file_pos += address;
     }
 
-    // read 16 at a time
-    // this downloads the file at file_pos of the total buffer
-    while (payload_received < payload_size)
-    {
-        if (read_from_wiimote(remote, file_pos, address) == -1)
-            return address;
+    return 0;
+}
 
-        // update payload and file pos
-        payload_received += 16;
-        file_pos += 16;
-        address += 0x10;
-        print_progress(remote, "DATA DOWNLOADED:", (float)payload_received, (float)payload_size);
-    }
-    payload_received = payload_size;
-    print_progress(remote, "DATA DOWNLOADED:", (float)payload_received, (float)payload_size);
+/**
+ * @brief pick_version
+ *
+ * @param Transfer* transfers - the downloads
+ * @param int count - the number of downloads
+ *
+ * @returns a finished download of the version of the file most parts are here of, one with
+ *      enough of them to stitch first, or -1 if no download finished
+ */
+int pick_version(Transfer *transfers, int count)
+{
+    int best = -1, best_score = 0;
+    int i, j;
 
-    // save downloaded data
-    printf("\n[INFO] Data successfully downloaded. Preparing to write to file\n");
-    FILE *fp;
-    fopen_s(&fp, file_name, "wb");
-    fwrite(file_buffer, payload_size + 0x30, sizeof(char), fp);
-    // end download
-    printf("[INFO] Data successfully written\n");
-    alert_remote(remote);
-    fclose(fp);
+    for (i = 0; i < count; i++)
+    {
+        Transfer *t = &transfers[i];
+        int needed  = t->stripe_k ? t->stripe_k : t->tot_wpf;
+        int parts   = 0;
+        if (t->state != TRANSFER_DONE)
+            continue;
+        for (j = 0; j < count; j++)
+            parts += (transfers[j].state == TRANSFER_DONE && same_version(t, &transfers[j]));
+        if (parts >= needed)
+            parts += count;
+        if (parts > best_score)
+        {
+            best       = i;
+            best_score = parts;
+        }
+    }
 
-    return -1;
+    return best;
 }
 
-void handle_download_request(wiimote **wiimotes, char *file_name, WiimotePartialFile *wpf)
+void handle_download_request(wiimote **wiimotes, char *file_name, WiimotePartialFile *wpf, int stage)
 {
-    int address = 0;                  // result from an operation
-    char buffer[MAX_WIIMOTE_PAYLOAD]; // used to hold data received/sent
+    Transfer transfers[MAX_WIIMOTES]; // one part of the file per remote
+    Transfer listings[MAX_WIIMOTES];  // what every remote holds
+    char *parts[RS_MAX_PARTS] = {0};
+    uint32_t sizes[RS_MAX_PARTS];
+    char addr[18];
+    Journal journal;
+    Journal *last_run = journal_load(&journal) ? &journal : NULL;
+    int i, part, version, count = 0, found = 0, needed = 0, missing = 0;
+
+    printf("[INFO] Reading the remotes' directories...\n");
+    wiimotes = list_remotes(wiimotes, listings);
+    if (!wiimotes)
+        return;
+    wpf->file_name[0] = '\0';
+    wpf->file_ext[0]  = '\0';
+    if (file_name && !get_file_name2(file_name, wpf))
+    {
+        printf("[ERROR] %s is not a name a remote could hold\n", file_name);
+        return;
+    }
+    if (!pick_file(listings, wpf))
+    {
+        if (file_name)
+            printf("[ERROR] No remote holds %s\n", file_name);
+        else
+            printf("[ERROR] No remote holds a file\n");
+        return;
+    }
+
+    // every remote holding a part of the file reads it
+    for (i = 0; i < MAX_WIIMOTES; i++)
+    {
+        Transfer *l = &listings[i];
+        int e       = (l->state == TRANSFER_DONE) ? dir_find(&l->dir, wpf->file_name, wpf->file_ext, 0) : -1;
+        if (e < 0)
+            continue;
+        remote_address(l->remote, addr);
+        init_download(&transfers[count++], l->remote, &l->dir, &l->dir.entries[e],
+                      journal_find(last_run, 0, addr, NULL));
+    }
 
-    do
+    // every remote reads its part at the same time
+    while (run_transfers(transfers, count))
     {
-        address = download_file(wiimotes[wpf->cur_wpf - 1], buffer, file_name, address, wpf);
+        int failed = 0;
+        for (i = 0; i < count; i++)
+            failed += (transfers[i].state == TRANSFER_FAILED);
+        if (!failed || missing)
+            break;
 
-        // handler
-        if (address >= 0)
+        // completely restart the app, failed transfers pick up again at their address
+        wiiuse_cleanup(wiimotes, MAX_WIIMOTES);
+        wiimotes = connect_remotes();
+        printf("\n");
+        if (!any_wiimote_connected(wiimotes, MAX_WIIMOTES))
+            return;
+        missing = !reattach_transfers(wiimotes, transfers, count);
+    }
+
+    // every part of the file has to be here before stitching, or enough of them when it is striped,
+    // and all of the same version
+    wpf->tot_wpf = 0;
+    version      = pick_version(transfers, count);
+    if (version >= 0)
+    {
+        Transfer *v  = &transfers[version];
+        wpf->tot_wpf = v->tot_wpf;
+        needed       = v->stripe_k ? v->stripe_k : v->tot_wpf;
+        strcpy(wpf->file_name, v->file_name);
+        strcpy(wpf->file_ext, v->file_ext);
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (transfers[i].state == TRANSFER_DONE && !same_version(&transfers[i], &transfers[version]))
+            printf("[INFO] Remote %d holds part of another version of %s.%s, leaving it out\n",
+                   transfers[i].remote->unid, wpf->file_name, wpf->file_ext);
+    }
+    for (part = 1; part <= wpf->tot_wpf && part <= RS_MAX_PARTS; part++)
+    {
+        for (i = 0; i < count; i++)
         {
-            // this prepares to call the method to restart at a specific point
-            // completely restart the app
-            wiiuse_cleanup(wiimotes, MAX_WIIMOTES);
-            wiimotes = connect_remotes();
-            printf("\n");
-        } else if (address == -1)
+            if (transfers[i].state == TRANSFER_DONE && transfers[i].cur_wpf == part &&
+                same_version(&transfers[i], &transfers[version]))
+                break;
+        }
+        if (i == count)
         {
-            // update download stuff
-            wpf->cur_wpf++;
-            address          = 0;
-            payload_received = 0;
-            if (wpf->cur_wpf > tot_wiimotes)
+            if (needed == wpf->tot_wpf)
             {
-                printf("[INFO] All wpf's downloaded. Stitching file...\n");
-                int res = stitch_together_wpfs(wpf);
-                break;
+                printf("[ERROR] Part %d of %s.%s is not on any connected remote\n", part, wpf->file_name,
+                       wpf->file_ext);
+                return;
             }
+            continue;
         }
-    } while (any_wiimote_connected(wiimotes, MAX_WIIMOTES) && address != -2);
+        parts[part - 1] = transfers[i].buffer;
+        sizes[part - 1] = transfers[i].size;
+        found++;
+    }
+    if (found < needed)
+    {
+        printf("[ERROR] Only %d of the %d parts of %s.%s needed are on the connected remotes\n", found, needed,
+               wpf->file_name, wpf->file_ext);
+        return;
+    }
+    if (!wpf->tot_wpf)
+    {
+        printf("[ERROR] No remote holds a file\n");
+        return;
+    }
+
+    if (stage)
+    {
+        // leave the wpfs on disk instead of putting the file back together
+        for (part = 0; part < count; part++)
+        {
+            Transfer *t = &transfers[part];
+            if (t->state == TRANSFER_DONE && same_version(t, &transfers[version]) && save_transfer(t))
+                printf("[INFO] Staged %s\n", t->wpf_name);
+        }
+        journal_clear();
+        return;
+    }
+
+    printf("[INFO] All wpf's downloaded. Stitching file...\n");
+    if (stitch_together_buffers(wpf, parts, sizes, RS_MAX_PARTS))
+        journal_clear();
 }
 
-void run_selected_process(wiimote **wiimotes, char *file_name, int mode)
+void run_selected_process(wiimote **wiimotes, char *file_name, int mode, int parity)
 {
     // this data is used to upload/download data
     WiimotePartialFile wpf;
@@ -490,10 +708,22 @@ void run_selected_process(wiimote **wiimotes, char *file_name, int mode)
     switch (mode)
     {
     case 0:
-        handle_upload_request(wiimotes, file_name, &wpf);
+        handle_upload_request(wiimotes, file_name, &wpf, parity, 0);
         break;
     case 1:
-        handle_download_request(wiimotes, file_name, &wpf);
+        handle_download_request(wiimotes, file_name, &wpf, 0);
+        break;
+    case 3:
+        handle_download_request(wiimotes, file_name, &wpf, 1);
+        break;
+    case 4:
+        handle_list_request(wiimotes);
+        break;
+    case 5:
+        handle_upload_request(wiimotes, file_name, &wpf, 0, 1);
+        break;
+    case 6:
+        handle_restore_request(wiimotes);
         break;
     }
 }
@@ -509,13 +739,48 @@ int main(int argc, char **argv)
     /**
      * 0 - UPLOAD
      * 1 - DOWNLOAD
+     * 2 - STAGE, write the wpfs of a file to disk
+     * 3 - STAGED DOWNLOAD, keep the downloaded wpfs on disk
+     * 4 - LIST, print the files on every remote
+     * 5 - DELTA UPLOAD, write only the blocks that changed since the last upload
+     * 6 - RESTORE, write the Mii data kept on the host back to the remotes
      */
     int mode;
-    char *file_name;
-    if (argc == 2) // upload
+    int parity      = 0;
+    char *file_name = NULL; // NULL downloads the first file any remote lists
+    if (argc == 3 && !strcmp(argv[1], STAGE_ARG)) // stage
+    {
+        WiimotePartialFile wpf;
+        char name[17];
+        char ext[17];
+        wpf.file_name = name;
+        wpf.file_ext  = ext;
+        return !create_wpf_files(argv[2], &wpf);
+    } else if (argc == 2 && !strcmp(argv[1], STAGE_ARG)) // staged download
+    {
+        mode = 3;
+    } else if (argc == 3 && !strcmp(argv[1], DOWNLOAD_ARG)) // download by name
+    {
+        file_name = argv[2];
+        mode      = 1;
+    } else if (argc == 2 && !strcmp(argv[1], LIST_ARG)) // list
     {
-        mode      = 0;
-        file_name = argv[1];
+        mode = 4;
+    } else if (argc == 2 && !strcmp(argv[1], MII_ARG)) // restore
+    {
+        mode = 6;
+    } else if (argc == 2 || (argc == 4 && !strcmp(argv[1], PARITY_ARG)) ||
+               (argc == 3 && !strcmp(argv[1], DELTA_ARG))) // upload
+    {
+        mode      = (argc == 3) ? 5 : 0;
+        file_name = argv[argc - 1];
+        if (argc == 4)
+            parity = atoi(argv[2]);
+        if (argc == 4 && (parity < 1 || parity >= MAX_WIIMOTES))
+        {
+            printf("[ERROR] Between 1 and %d parity parts can be added\n", MAX_WIIMOTES - 1);
+            return 0;
+        }
         if (findSize(file_name) == -1 || !payload_size)
         {
             printf("[ERROR] File '%s' does not exist, or is empty. Please select an existing file to upload",
@@ -523,14 +788,21 @@ int main(int argc, char **argv)
         }
     } else if (argc == 1) // download
     {
-        char file[39];
-        file_name = file;
-        mode      = 1;
+        mode = 1;
     } else // help
     {
         printf("[ERROR] Invalid arguments. Valid args:\n\n<file_name>\tIf given a valid file, will attempt "
                "to upload it\n"
-               "NONE       \tWill attempt to download the file on remote\n");
+               "NONE       \tWill attempt to download the first file on the remotes\n"
+               "-d <file_name>\tDownloads the file of that name off the remotes\n"
+               "-l         \tLists the files on every remote\n"
+               "-u <file_name>\tUploads a file over its last upload, writing only the blocks that changed\n"
+               "-m         \tPuts the Mii data uploads moved off the remotes back, dropping the files in "
+               "its place\n"
+               "-s <file_name>\tWrites the .wpf files for a file to disk, without uploading\n"
+               "-s         \tDownloads the .wpf files on remote, without stitching them\n"
+               "-p <parity> <file_name>\tUploads a file striped over the remotes, with <parity> extra "
+               "parts so that any of the remotes but <parity> can rebuild it\n");
         return 0;
     }
 
@@ -549,7 +821,7 @@ int main(int argc, char **argv)
 
     printf("\n================================\n\n");
 
-    run_selected_process(wiimotes, file_name, mode);
+    run_selected_process(wiimotes, file_name, mode, parity);
 
     // wait for rumble input to end
     printf("\n[INFO] Exiting...\n");
@@ -0,0 +1,180 @@
+/**
+ * rs
+ *
+ * purpose: to spread a file over more remotes than it
+ *      needs, so it survives some of them going missing
+ */
+
+#include "rs.h"
+
+#include <string.h>
+
+static uint8_t gf_exp[512];
+static uint8_t gf_log[256];
+
+/**
+ * @brief gf_init
+ *
+ * builds the log tables for GF(256) over x^8 + x^4 + x^3 + x^2 + 1
+ */
+static void gf_init()
+{
+    static int ready = 0;
+    int i, x = 1;
+
+    if (ready)
+        return;
+    for (i = 0; i < 255; i++)
+    {
+        gf_exp[i] = (uint8_t)x;
+        gf_log[x] = (uint8_t)i;
+        x <<= 1;
+        if (x & 0x100)
+            x ^= 0x11d;
+    }
+    // doubled up so a product never has to wrap its exponent
+    for (i = 255; i < 512; i++)
+        gf_exp[i] = gf_exp[i - 255];
+    ready = 1;
+}
+
+static uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    if (!a || !b)
+        return 0;
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+static uint8_t gf_inv(uint8_t a) { return gf_exp[255 - gf_log[a]]; }
+
+/**
+ * @brief coefficient
+ *
+ * @param int k, int row, int col
+ *
+ * @returns the generator matrix entry for part row and data part col.
+ *      data rows are the identity, parity rows are 1 / (x_row + y_col)
+ */
+static uint8_t coefficient(int k, int row, int col)
+{
+    if (row < k)
+        return row == col;
+    return gf_inv((uint8_t)(row ^ col));
+}
+
+/**
+ * @brief add_scaled
+ *
+ * @param uint8_t *dst, uint8_t *src, uint8_t c, uint32_t len
+ *
+ * dst += c * src, over the whole part
+ */
+static void add_scaled(uint8_t *dst, uint8_t *src, uint8_t c, uint32_t len)
+{
+    uint32_t i;
+
+    if (!c)
+        return;
+    for (i = 0; i < len; i++)
+        dst[i] ^= gf_mul(c, src[i]);
+}
+
+void rs_encode(uint8_t **data, int k, uint8_t **parity, int m, uint32_t len)
+{
+    int p, i;
+
+    gf_init();
+    for (p = 0; p < m; p++)
+    {
+        memset(parity[p], 0, len);
+        for (i = 0; i < k; i++)
+            add_scaled(parity[p], data[i], coefficient(k, k + p, i), len);
+    }
+}
+
+int rs_reconstruct(uint8_t **parts, int k, int n, uint32_t len, uint8_t **out)
+{
+    uint8_t matrix[RS_MAX_PARTS][RS_MAX_PARTS];
+    uint8_t inverse[RS_MAX_PARTS][RS_MAX_PARTS];
+    int rows[RS_MAX_PARTS];
+    int found = 0;
+    int i, j, col;
+
+    gf_init();
+    if (k > RS_MAX_PARTS)
+        return 0;
+
+    // the first k parts that came back are enough
+    for (i = 0; i < n && found < k; i++)
+    {
+        if (parts[i])
+            rows[found++] = i;
+    }
+    if (found < k)
+        return 0;
+
+    for (i = 0; i < k; i++)
+    {
+        for (j = 0; j < k; j++)
+        {
+            matrix[i][j]  = coefficient(k, rows[i], j);
+            inverse[i][j] = (i == j);
+        }
+    }
+
+    // gauss-jordan, every square Cauchy submatrix is invertible so a pivot always turns up
+    for (col = 0; col < k; col++)
+    {
+        uint8_t scale;
+        int pivot = col;
+        while (pivot < k && !matrix[pivot][col])
+            pivot++;
+        if (pivot == k)
+            return 0;
+        if (pivot != col)
+        {
+            for (j = 0; j < k; j++)
+            {
+                uint8_t tmp       = matrix[col][j];
+                matrix[col][j]    = matrix[pivot][j];
+                matrix[pivot][j]  = tmp;
+                tmp               = inverse[col][j];
+                inverse[col][j]   = inverse[pivot][j];
+                inverse[pivot][j] = tmp;
+            }
+        }
+
+        scale = gf_inv(matrix[col][col]);
+        for (j = 0; j < k; j++)
+        {
+            matrix[col][j]  = gf_mul(matrix[col][j], scale);
+            inverse[col][j] = gf_mul(inverse[col][j], scale);
+        }
+        for (i = 0; i < k; i++)
+        {
+            uint8_t factor = matrix[i][col];
+            if (i == col || !factor)
+                continue;
+            for (j = 0; j < k; j++)
+            {
+                matrix[i][j] ^= gf_mul(factor, matrix[col][j]);
+                inverse[i][j] ^= gf_mul(factor, inverse[col][j]);
+            }
+        }
+    }
+
+    // every data part is a mix of the parts that were found
+    for (i = 0; i < k; i++)
+    {
+        if (rows[i] == i)
+        {
+            memcpy(out[i], parts[i], len);
+            continue;
+        }
+        memset(out[i], 0, len);
+        for (j = 0; j < k; j++)
+            add_scaled(out[i], parts[rows[j]], inverse[i][j], len);
+    }
+
+    return 1;
+}
@@ -0,0 +1,41 @@
+/**
+ * rs
+ *
+ * purpose: to spread a file over more remotes than it
+ *      needs, so it survives some of them going missing.
+ *      k data parts get m parity parts, and any k of the
+ *      k + m parts can rebuild the data. the parity is a
+ *      Reed-Solomon code over GF(256), made with a Cauchy
+ *      matrix so every choice of k parts can be inverted
+ */
+#ifndef RS_H
+#define RS_H
+#include <stdint.h>
+
+#define RS_MAX_PARTS 16
+
+/**
+ * @brief rs_encode
+ *
+ * @param uint8_t** data - the k data parts
+ * @param int k - the number of data parts
+ * @param uint8_t** parity - the m parity parts to fill in
+ * @param int m - the number of parity parts
+ * @param uint32_t len - the length of every part
+ */
+void rs_encode(uint8_t **data, int k, uint8_t **parity, int m, uint32_t len);
+
+/**
+ * @brief rs_reconstruct
+ *
+ * @param uint8_t** parts - all k + m parts in order, NULL for the ones that are missing
+ * @param int k - the number of data parts
+ * @param int n - the total number of parts
+ * @param uint32_t len - the length of every part
+ * @param uint8_t** out - k buffers of len bytes to rebuild the data parts into
+ *
+ * @returns 1 on success, 0 if fewer than k parts are present
+ */
+int rs_reconstruct(uint8_t **parts, int k, int n, uint32_t len, uint8_t **out);
+
+#endif
@@ -0,0 +1,1442 @@
+/**
+ * transfer
+ *
+ * purpose: to move .wpf data on and off of wii remotes.
+ *      every remote gets a Transfer, which walks through
+ *      reading its directory, or reading or writing one
+ *      of the wpfs the directory lists, one step at a time.
+ *      run_transfers polls all remotes in a single loop
+ *      and advances each Transfer as its reports arrive,
+ *      so every remote works on its part at the same time
+ */
+
+#include "transfer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cache.h"
+#include "io.h"
+#include "journal.h"
+
+#define READ_WINDOW 0x200         // bytes asked for per read request, the remote answers with 32 reports
+#define VERIFY_STALLS 3           // read back passes in a row that fix nothing before a transfer gives up
+#define RTO_INITIAL 250000        // microseconds to wait for an answer before the remote has been timed
+#define RTO_MIN 10000             // microseconds the wait never drops below, the poll only looks every 10ms
+#define RTO_MAX 5000000           // microseconds the wait never grows past, however slow the remote
+#define TRANSFER_BACKOFFS 2       // times the wait is doubled before a silent remote counts as gone
+#define JOURNAL_INTERVAL 1000000  // microseconds between journal saves while transfers run
+#define POLL_TIMEOUT 10           // milliseconds to wait for a report, the poll returns as soon as one arrives
+
+/**
+ * @brief progress_of
+ *
+ * @param Transfer *t
+ *
+ * @returns how many bytes of the transfer are through
+ */
+static uint32_t progress_of(Transfer *t)
+{
+    switch (t->state)
+    {
+    case TRANSFER_VERIFY:
+    case TRANSFER_REWRITE:
+    case TRANSFER_COMMIT:
+    case TRANSFER_DONE:
+        return t->size;
+    default:
+        return t->address;
+    }
+}
+
+void print_progress(Transfer *transfers, int count, char *title)
+{
+    char completed[51];
+    float rec = 0, tot = 0;
+    int i = 0;
+    char a = 177, b = 219;
+
+    for (; i < count; i++)
+    {
+        Transfer *t = &transfers[i];
+        float p;
+        int leds;
+        if (!t->size || t->state == TRANSFER_INVALID)
+            continue;
+        rec += progress_of(t);
+        tot += t->size;
+
+        // update LEDS, only when they change
+        p = progress_of(t) / (float)t->size;
+        if (p <= 0.25)
+            leds = 0x00;
+        else if (p <= 0.5)
+            leds = (1 << 4);
+        else if (p <= 0.75)
+            leds = (1 << 5) | (1 << 4);
+        else
+            leds = (1 << 6) | (1 << 5) | (1 << 4);
+        if (leds != t->leds)
+        {
+            t->leds = leds;
+            wiiuse_set_leds(t->remote, leds);
+        }
+    }
+    if (!tot)
+        return;
+
+    // update progress bar
+    float p = rec / tot;
+    i       = 0;
+    do
+    {
+        completed[i] = (i < (50.0 * p)) ? b : a;
+    } while (++i < 50.0);
+    completed[i] = '\0';
+
+    printf("%s [%s]     %4dB / %4dB\r", title, completed, (int)rec, (int)tot);
+}
+
+// what a finished remote plays to let the user know, each step held for its time
+typedef struct AlertStep
+{
+    int leds;
+    int rumble;
+    uint32_t hold_us;
+} AlertStep;
+
+static const AlertStep alert_steps[] = {
+    {0xF0, 1, 175000},
+    {0x00, 0, 50000},
+    {0x00, 1, 200000},
+    {0xF0, 0, 0},
+};
+
+#define ALERT_STEPS (int)(sizeof(alert_steps) / sizeof(AlertStep))
+
+/**
+ * @brief step_alert
+ *
+ * @param Transfer *t
+ *
+ * @returns 1 while the remote is still playing its alert, 0 once it is done or has none to play
+ *
+ * plays a finished remote's alert one step at a time, the other remotes carry on in the meantime
+ */
+static int step_alert(Transfer *t)
+{
+    const AlertStep *step;
+
+    // a listing is only the start of a transfer, there is nothing to tell the user yet
+    if (t->state != TRANSFER_DONE || t->listing || t->alert_step >= ALERT_STEPS)
+        return 0;
+    if (t->alert_step && wiiuse_ticks_us() < t->alert_at)
+        return 1;
+
+    step = &alert_steps[t->alert_step++];
+    wiiuse_set_leds(t->remote, step->leds);
+    wiiuse_rumble(t->remote, step->rumble);
+    t->alert_at = wiiuse_ticks_us() + step->hold_us;
+
+    return t->alert_step < ALERT_STEPS;
+}
+
+/**
+ * @brief block_is_done
+ *
+ * @param Transfer *t, uint32_t block
+ *
+ * @returns 1 if the 16 byte block is written or read, 0 if not
+ */
+static int block_is_done(Transfer *t, uint32_t block) { return (t->blocks[block / 8] >> (block % 8)) & 1; }
+
+/**
+ * @brief mark_blocks
+ *
+ * @param Transfer *t, uint32_t from, uint32_t to, int done
+ *
+ * marks every 16 byte block in the range as done or not done,
+ * and updates how many bytes are done
+ */
+static void mark_blocks(Transfer *t, uint32_t from, uint32_t to, int done)
+{
+    uint32_t block;
+    uint32_t count = 0;
+
+    for (block = from / 16; block < (to + 15) / 16; block++)
+    {
+        if (done)
+            t->blocks[block / 8] |= (1 << (block % 8));
+        else
+            t->blocks[block / 8] &= ~(1 << (block % 8));
+    }
+
+    for (block = 0; block < (t->size + 15) / 16; block++)
+        count += block_is_done(t, block);
+    t->address = (count * 16 > t->size) ? t->size : count * 16;
+}
+
+/**
+ * @brief next_missing
+ *
+ * @param Transfer *t, uint32_t *from, uint32_t *to
+ *
+ * @returns 1 and the first run of blocks that are not done, 0 if every block is done
+ */
+static int next_missing(Transfer *t, uint32_t *from, uint32_t *to)
+{
+    uint32_t blocks = (t->size + 15) / 16;
+    uint32_t block  = 0;
+
+    while (block < blocks && block_is_done(t, block))
+        block++;
+    if (block == blocks)
+        return 0;
+    *from = block * 16;
+    while (block < blocks && !block_is_done(t, block))
+        block++;
+    *to = (block * 16 > t->size) ? t->size : block * 16;
+
+    return 1;
+}
+
+/**
+ * @brief note_blocks
+ *
+ * @param Transfer *t, uint32_t blocks
+ *
+ * records how long the blocks that just came through took, sharing
+ * the time since the last ones came through evenly between them
+ */
+static void note_blocks(Transfer *t, uint32_t blocks)
+{
+    uint64_t now;
+    uint32_t each;
+
+    if (!t->stats || !blocks)
+        return;
+    now  = wiiuse_ticks_us();
+    each = (uint32_t)((now - t->stats->last_us) / blocks);
+    while (blocks-- && t->stats->samples < t->stats->capacity)
+        t->stats->latency_us[t->stats->samples++] = each;
+    t->stats->last_us = now;
+}
+
+/**
+ * @brief writing
+ *
+ * @param Transfer *t
+ *
+ * @returns 1 while the transfer waits on write acks, 0 while it waits on reads
+ */
+static int writing(Transfer *t) { return t->blocks_acked < t->blocks_queued; }
+
+/**
+ * @brief reports_due
+ *
+ * @param Transfer *t
+ *
+ * @returns how many reports the remote sends before the next answer counts, one
+ *      ack when writing, or every report of the read window in flight
+ */
+static uint32_t reports_due(Transfer *t)
+{
+    uint32_t window = READ_WINDOW;
+
+    if (writing(t))
+        return 1;
+    if (t->end > t->cursor && t->end - t->cursor < READ_WINDOW)
+        window = t->end - t->cursor;
+
+    return (window + 15) / 16;
+}
+
+/**
+ * @brief start_clock
+ *
+ * @param Transfer *t
+ *
+ * starts waiting on the remote, before anything has been asked of it. what
+ * it was timed at before is kept, a reconnect doesn't make a remote faster
+ */
+static void start_clock(Transfer *t)
+{
+    RoundTrip *rtt = writing(t) ? &t->write_rtt : &t->read_rtt;
+    uint64_t rto   = RTO_INITIAL;
+
+    if (rtt->srtt_us)
+        rto = ((uint64_t)rtt->srtt_us + 4 * (uint64_t)rtt->rttvar_us) * reports_due(t);
+    if (rto < RTO_MIN)
+        rto = RTO_MIN;
+    if (rto > RTO_MAX)
+        rto = RTO_MAX;
+    t->rto_us        = (uint32_t)rto;
+    t->backoffs      = 0;
+    t->replies       = t->remote->replies;
+    t->last_progress = wiiuse_ticks_us();
+    t->deadline      = t->last_progress + t->rto_us;
+}
+
+/**
+ * @brief note_progress
+ *
+ * @param Transfer *t
+ * @param int write - 1 for write acks, 0 for a read window
+ * @param uint32_t reports - how many reports came back since the last answer
+ *
+ * something came back from the remote. requests are pipelined, so the time
+ * since the last answer is how long the remote takes to come up with the
+ * reports in between. shared out per report, it is folded into the smoothed
+ * round trip and its variance as in rfc 6298, and the wait set from those.
+ * acks and read reports are timed apart, they don't come at the same pace.
+ * an answer to a request that was sent again isn't timed, there is no telling
+ * which of the two it answers (karn's algorithm)
+ */
+static void note_progress(Transfer *t, int write, uint32_t reports)
+{
+    RoundTrip *rtt  = write ? &t->write_rtt : &t->read_rtt;
+    uint64_t now    = wiiuse_ticks_us();
+    uint64_t taken  = (now - t->last_progress > RTO_MAX) ? RTO_MAX : now - t->last_progress;
+    uint32_t sample = (uint32_t)(taken / (reports ? reports : 1));
+
+    if (t->backoffs)
+    {
+        start_clock(t);
+        return;
+    }
+    if (!rtt->srtt_us)
+    {
+        // nothing to smooth against yet, +1 so a remote that answers at once still counts as timed
+        rtt->srtt_us   = sample + 1;
+        rtt->rttvar_us = sample / 2;
+    } else
+    {
+        uint32_t err   = (sample > rtt->srtt_us) ? sample - rtt->srtt_us : rtt->srtt_us - sample;
+        rtt->rttvar_us = rtt->rttvar_us - rtt->rttvar_us / 4 + err / 4;
+        rtt->srtt_us   = rtt->srtt_us - rtt->srtt_us / 8 + sample / 8;
+    }
+    start_clock(t);
+}
+
+/**
+ * @brief timed_out
+ *
+ * @param Transfer *t
+ *
+ * @returns 1 once the remote has kept quiet through every backoff, 0 while it is worth waiting on
+ *
+ * a remote that misses its wait is asked again for what it left unanswered,
+ * a lost reply would hold the request up for good, and gets twice as long,
+ * the same way tcp backs off. a slow remote is waited out, a lossy one costs
+ * a wait per lost reply, and a gone one is noticed after a few waits. a remote
+ * that answered part of a request since the last wait isn't quiet, the wait
+ * starts over from its round trip
+ */
+static int timed_out(Transfer *t)
+{
+    uint64_t now = wiiuse_ticks_us();
+
+    if (now < t->deadline)
+        return 0;
+    if (t->remote->replies != t->replies)
+        start_clock(t);
+    if (++t->backoffs > TRANSFER_BACKOFFS)
+        return 1;
+    if (wiiuse_resend_requests(t->remote) && t->stats)
+        t->stats->retries++;
+    t->rto_us   = (t->rto_us > RTO_MAX / 2) ? RTO_MAX : t->rto_us * 2;
+    t->deadline = now + t->rto_us;
+
+    return 0;
+}
+
+/**
+ * @brief stalled
+ *
+ * @param Transfer *t
+ * @param uint32_t bad - how many blocks or groups the last pass left wrong
+ *
+ * @returns 1 once VERIFY_STALLS passes in a row have left as many wrong as the one before
+ *
+ * a pass that leaves fewer wrong is getting somewhere, however many of those it takes
+ */
+static int stalled(Transfer *t, uint32_t bad)
+{
+    if (t->last_bad && bad >= t->last_bad)
+        t->passes++;
+    else
+        t->passes = 0;
+    t->last_bad = bad;
+
+    return t->passes >= VERIFY_STALLS;
+}
+
+/**
+ * @brief note_acks
+ *
+ * @param Transfer *t
+ *
+ * takes in the blocks the remote acked since the last look, their status
+ * fills in in the order they were sent. a block the remote failed to write
+ * is left as not done. all of them together make one round trip sample
+ */
+static void note_acks(Transfer *t)
+{
+    uint32_t acked = t->blocks_acked;
+
+    while (t->blocks_acked < t->blocks_queued && t->write_status[t->blocks_acked] != WIIUSE_WRITE_PENDING)
+    {
+        // the blocks of the directory aren't blocks of the wpf
+        if (t->state != TRANSFER_COMMIT && !t->write_status[t->blocks_acked])
+        {
+            uint32_t offset = t->write_blocks[t->blocks_acked] * 16;
+            mark_blocks(t, offset, offset + 16, 1);
+            note_blocks(t, 1);
+        }
+        t->blocks_acked++;
+    }
+    if (t->blocks_acked > acked)
+        note_progress(t, 1, t->blocks_acked - acked);
+}
+
+/**
+ * @brief queue_reads
+ *
+ * @param Transfer *t, char *buffer
+ * @param uint32_t base - the eeprom address of buffer[0]
+ * @param uint32_t from, uint32_t to - the range of buffer to read
+ *
+ * Queues the range as READ_WINDOW sized read requests all at once, so the
+ * library sends the next one the moment the last 0x21 report of the previous
+ * one lands. event_data_read puts each report in place by its offset
+ *
+ * @returns 1 on success, 0 on failure
+ */
+static int queue_reads(Transfer *t, char *buffer, uint32_t base, uint32_t from, uint32_t to)
+{
+    uint32_t queued = from;
+
+    t->cursor = from;
+    t->end    = to;
+    start_clock(t);
+    while (queued < to)
+    {
+        uint16_t size = (to - queued > READ_WINDOW) ? READ_WINDOW : (uint16_t)(to - queued);
+        if (!wiiuse_read_data(t->remote, (byte *)buffer + queued, base + queued, size))
+            return 0;
+        queued += size;
+        t->requests++;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief add_write
+ *
+ * @param Transfer *t, uint32_t from, uint32_t to
+ *
+ * adds a 16 byte aligned range of the wpf to the runs send_writes writes,
+ * joining it onto the last run when the two meet
+ */
+static void add_write(Transfer *t, uint32_t from, uint32_t to)
+{
+    struct wiiuse_iovec_t *last = t->write_runs ? &t->writes[t->write_runs - 1] : NULL;
+    uint32_t block;
+
+    if (last && last->addr + last->len == t->base + from)
+    {
+        last->len += to - from;
+    } else
+    {
+        t->writes[t->write_runs].addr = t->base + from;
+        t->writes[t->write_runs].data = (byte *)t->buffer + from;
+        t->writes[t->write_runs].len  = to - from;
+        t->write_runs++;
+    }
+    // every run starts on a block, so the library splits it into exactly these blocks
+    for (block = from / 16; block < (to + 15) / 16; block++)
+        t->write_blocks[t->blocks_queued++] = (uint16_t)block;
+}
+
+/**
+ * @brief send_writes
+ *
+ * @param Transfer *t
+ *
+ * Hands every run added since the last call to the library as one vectored
+ * write. It splits the runs into 16 byte reports, keeps a few of them on the
+ * wire ahead of their acks, and fills in write_status as the acks come back
+ *
+ * @returns 1 on success, or when there is nothing to write, 0 on failure
+ */
+static int send_writes(Transfer *t)
+{
+    int runs      = t->write_runs;
+    t->write_runs = 0;
+    if (!runs)
+        return 1;
+    if (!wiiuse_write_data_v(t->remote, t->writes, runs, t->write_status, NULL, NULL))
+        return 0;
+    t->requests += t->blocks_queued;
+    start_clock(t);
+
+    return 1;
+}
+
+/**
+ * @brief start_writes
+ *
+ * @param Transfer *t
+ *
+ * writes every block that is not on the remote yet
+ */
+static void start_writes(Transfer *t)
+{
+    uint32_t block;
+
+    t->state         = TRANSFER_WRITE;
+    t->blocks_queued = 0;
+    t->blocks_acked  = 0;
+    for (block = 0; block < (t->size + 15) / 16; block++)
+    {
+        uint32_t from = block * 16;
+        if (!block_is_done(t, block))
+            add_write(t, from, (t->size - from > 16) ? from + 16 : t->size);
+    }
+    if (!send_writes(t))
+        t->state = TRANSFER_FAILED;
+}
+
+static void start_upload(Transfer *t);
+
+/**
+ * @brief start_backup
+ *
+ * @param Transfer *t
+ *
+ * reads the Mii blocks into check_buf. a backup kept by an earlier try
+ * is kept as it is, by now the blocks may hold part of the wpf
+ */
+static void start_backup(Transfer *t)
+{
+    char name[39];
+    FILE *fp;
+
+    mii_backup_name(t->remote_addr, name);
+    if (!fopen_s(&fp, name, "rb"))
+    {
+        fclose(fp);
+        t->backup = 0;
+        start_upload(t);
+        return;
+    }
+    t->state = TRANSFER_BACKUP;
+    if (!queue_reads(t, t->check_buf, MII_ADDR, 0x00, MII_SIZE))
+        t->state = TRANSFER_FAILED;
+}
+
+/**
+ * @brief save_backup
+ *
+ * @param Transfer *t
+ *
+ * writes the Mii blocks that were just read to disk, and goes on with the upload.
+ * blocks that were never written hold the same byte throughout, and aren't kept
+ */
+static void save_backup(Transfer *t)
+{
+    char name[39];
+    FILE *fp;
+    size_t written = 0;
+    uint32_t i;
+
+    for (i = 1; i < MII_SIZE && t->check_buf[i] == t->check_buf[0]; i++)
+        ;
+    if (i < MII_SIZE)
+    {
+        mii_backup_name(t->remote_addr, name);
+        if (!fopen_s(&fp, name, "wb"))
+        {
+            written = fwrite(t->check_buf, sizeof(char), MII_SIZE, fp);
+            fclose(fp);
+        }
+        if (written != MII_SIZE)
+        {
+            // without a copy the Mii data would be lost, the wpf goes nowhere
+            printf("\n[ERROR] Could not write %s\n", name);
+            remove(name);
+            t->state = TRANSFER_INVALID;
+            return;
+        }
+        printf("\n[INFO] Remote %d: Mii data kept in %s\n", t->remote->unid, name);
+    }
+    t->backup = 0;
+    start_upload(t);
+}
+
+/**
+ * @brief start_diff
+ *
+ * @param Transfer *t
+ *
+ * reads what the remote holds where the wpf goes into check_buf, in one
+ * streamed pass. reading a block costs a fraction of writing one
+ */
+static void start_diff(Transfer *t)
+{
+    t->state = TRANSFER_DIFF;
+    if (!queue_reads(t, t->check_buf, t->base, 0x00, t->size))
+        t->state = TRANSFER_FAILED;
+}
+
+/**
+ * @brief check_diff
+ *
+ * @param Transfer *t
+ *
+ * marks every block the remote holds already as written, and writes the rest
+ */
+static void check_diff(Transfer *t)
+{
+    uint32_t offset;
+    uint32_t changed = 0;
+
+    for (offset = 0; offset < t->size; offset += 16)
+    {
+        uint32_t end = (t->size - offset > 16) ? offset + 16 : t->size;
+        if (memcmp(t->buffer + offset, t->check_buf + offset, end - offset))
+            changed++;
+        else
+            mark_blocks(t, offset, end, 1);
+    }
+    t->delta = 0;
+    printf("\n[INFO] Remote %d: %d of %d blocks of %s changed\n", t->remote->unid, changed,
+           (t->size + 15) / 16, t->wpf_name);
+    start_writes(t);
+}
+
+/**
+ * @brief start_upload
+ *
+ * @param Transfer *t
+ *
+ * keeps the Mii blocks the wpf goes in first if it has to, then finds out
+ * what changed for a delta upload, then writes
+ */
+static void start_upload(Transfer *t)
+{
+    if (t->backup)
+        start_backup(t);
+    else if (t->delta)
+        start_diff(t);
+    else
+        start_writes(t);
+}
+
+/**
+ * @brief start_verify
+ *
+ * @param Transfer *t
+ *
+ * reads the whole written wpf back into check_buf
+ */
+static void start_verify(Transfer *t)
+{
+    t->state = TRANSFER_VERIFY;
+    if (!queue_reads(t, t->check_buf, t->base, 0x00, t->size))
+        t->state = TRANSFER_FAILED;
+}
+
+/**
+ * @brief start_commit
+ *
+ * @param Transfer *t
+ *
+ * writes the directory with the new wpf in it, once the wpf itself is on the
+ * remote. until then the remote still lists whatever it held before
+ */
+static void start_commit(Transfer *t)
+{
+    // check_buf isn't needed until the table is read back, after the last block of it is acked
+    dir_build(&t->dir, t->check_buf);
+    t->state         = TRANSFER_COMMIT;
+    t->blocks_acked  = 0;
+    t->blocks_queued = WIIUSE_WRITE_BLOCKS(DIR_SIZE);
+
+    t->writes[0].addr = DIR_ADDR;
+    t->writes[0].data = (byte *)t->check_buf;
+    t->writes[0].len  = DIR_SIZE;
+    if (!wiiuse_write_data_v(t->remote, t->writes, 1, t->write_status, NULL, NULL))
+        t->state = TRANSFER_FAILED;
+    t->requests += t->blocks_queued;
+    start_clock(t);
+}
+
+/**
+ * @brief check_commit
+ *
+ * @param Transfer *t
+ *
+ * compares the directory that was read back against the one written,
+ * the upload is only done once the remote lists it
+ */
+static void check_commit(Transfer *t)
+{
+    char image[DIR_SIZE];
+
+    dir_build(&t->dir, image);
+    if (!memcmp(image, t->check_buf, DIR_SIZE))
+    {
+        CachedRemote *c = cache_commit(t->remote_addr, t->dir.generation, t->dir.crc);
+        cache_store(c, t->base, t->buffer, t->size);
+        cache_store(c, DIR_ADDR, image, DIR_SIZE);
+        t->passes   = 0;
+        t->last_bad = 0;
+        t->state    = TRANSFER_DONE;
+        return;
+    }
+    if (t->stats)
+        t->stats->retries += DIR_SIZE / 16;
+    if (stalled(t, 1))
+    {
+        printf("\n[ERROR] Remote %d: directory could not be written. Restarting soon...\n", t->remote->unid);
+        t->passes   = 0;
+        t->last_bad = 0;
+        t->state    = TRANSFER_FAILED;
+        return;
+    }
+    printf("\n[INFO] Remote %d: rewriting the directory\n", t->remote->unid);
+    start_commit(t);
+}
+
+/**
+ * @brief read_header
+ *
+ * @param Transfer *t
+ *
+ * @returns 1 on success, 0 if the remote holds no valid wpf, or not the one its directory lists
+ *
+ * fills in the transfer from the header of the downloaded wpf
+ */
+static int read_header(Transfer *t)
+{
+    WiimotePartialFile wpf;
+    uint32_t listed = t->size;
+
+    wpf.file_name = t->file_name;
+    wpf.file_ext  = t->file_ext;
+    // exit if corrupted
+    if (!read_wpf_header(t->buffer, &wpf) ||
+        (uint32_t)wpf.cur_wpf_size + wpf_data_offset(wpf.flags) != listed)
+    {
+        printf("\n[ERROR] Remote %d: download size of %dB is invalid\n", t->remote->unid, wpf.cur_wpf_size);
+        return 0;
+    }
+    t->file_size = wpf.file_size;
+    t->file_crc  = wpf_file_crc(t->buffer);
+    t->tot_wpf   = wpf.tot_wpf;
+    t->cur_wpf   = wpf.cur_wpf;
+    t->stripe_k  = wpf.stripe_k;
+    sprintf_s(t->wpf_name, WPF_NAME_SIZE, "%s%s%d.wpf", t->file_name, t->file_ext, t->cur_wpf);
+
+    return 1;
+}
+
+/**
+ * @brief list_legacy
+ *
+ * @param Transfer *t
+ *
+ * lists the wpf that was just read off a remote without a directory, which
+ * earlier builds wrote at address 0. a remote holding nothing lists nothing
+ */
+static void list_legacy(Transfer *t)
+{
+    WiimotePartialFile wpf;
+    DirEntry *e = &t->dir.entries[0];
+
+    wpf.file_name = e->name;
+    wpf.file_ext  = e->ext;
+    if (read_wpf_header(t->buffer, &wpf))
+    {
+        e->length     = (uint16_t)(wpf.cur_wpf_size + wpf_data_offset(wpf.flags));
+        e->part       = (uint16_t)wpf.cur_wpf;
+        e->parts      = (uint16_t)wpf.tot_wpf;
+        t->dir.legacy = 1;
+    } else
+    {
+        memset(&t->dir, 0, sizeof(Directory));
+    }
+    t->state = TRANSFER_DONE;
+}
+
+/**
+ * @brief list_directory
+ *
+ * @param Transfer *t
+ *
+ * parses the directory that was just read, a remote without one
+ * goes on to have its header read in case it holds an older wpf.
+ * when only the header of the table was read, and it has changed
+ * since the cache saw it, the rest is read first
+ */
+static void list_directory(Transfer *t)
+{
+    CachedRemote *c;
+
+    // only the header was read, the rest of the table is in check_buf from the cache as long as it matches
+    if (t->end < DIR_SIZE)
+    {
+        c = cache_find(t->remote_addr);
+        if (!c || memcmp(t->check_buf, c->image + DIR_ADDR, DIR_HEADER_SIZE))
+        {
+            if (!queue_reads(t, t->check_buf, DIR_ADDR, DIR_HEADER_SIZE, DIR_SIZE))
+                t->state = TRANSFER_FAILED;
+            return;
+        }
+    }
+
+    if (dir_parse(t->check_buf, &t->dir))
+    {
+        c = cache_open(t->remote_addr, t->dir.generation, t->dir.crc);
+        cache_store(c, DIR_ADDR, t->check_buf, DIR_SIZE);
+        t->state = TRANSFER_DONE;
+        return;
+    }
+    t->state = TRANSFER_HEADER;
+    if (!queue_reads(t, t->buffer, 0x00, 0x00, WPF_HEADER_SIZE))
+        t->state = TRANSFER_FAILED;
+}
+
+int save_transfer(Transfer *t)
+{
+    FILE *fp;
+    if (fopen_s(&fp, t->wpf_name, "wb"))
+    {
+        printf("\n[ERROR] Could not write %s\n", t->wpf_name);
+        return 0;
+    }
+    fwrite(t->buffer, sizeof(char), t->size, fp);
+    fclose(fp);
+
+    return 1;
+}
+
+/**
+ * @brief check_upload
+ *
+ * @param Transfer *t
+ *
+ * compares what was read back against the wpf, and queues
+ * every block that came back different to be written again
+ */
+static void check_upload(Transfer *t)
+{
+    uint32_t offset;
+
+    t->blocks_queued = 0;
+    t->blocks_acked  = 0;
+    for (offset = 0; offset < t->size; offset += 16)
+    {
+        uint32_t end = (t->size - offset > 16) ? offset + 16 : t->size;
+        if (memcmp(t->buffer + offset, t->check_buf + offset, end - offset))
+        {
+            mark_blocks(t, offset, end, 0);
+            add_write(t, offset, end);
+        }
+    }
+    if (!send_writes(t))
+    {
+        t->state = TRANSFER_FAILED;
+        return;
+    }
+
+    if (t->stats)
+        t->stats->retries += t->blocks_queued;
+    if (!t->blocks_queued)
+    {
+        t->passes   = 0;
+        t->last_bad = 0;
+        start_commit(t);
+    } else if (stalled(t, t->blocks_queued))
+    {
+        // this will occur if matches SUCK or keep sucking
+        printf("\n[ERROR] Remote %d: upload timed out. Restarting soon...\n", t->remote->unid);
+        t->passes   = 0;
+        t->last_bad = 0;
+        t->state    = TRANSFER_FAILED;
+    } else
+    {
+        printf("\n[INFO] Remote %d: rewriting %d mismatched blocks\n", t->remote->unid, t->blocks_queued);
+        t->state = TRANSFER_REWRITE;
+    }
+}
+
+/**
+ * @brief read_missing
+ *
+ * @param Transfer *t
+ *
+ * queues reads for the next run of blocks a download is missing.
+ * once there are none left the wpf's checksums are checked, and
+ * only the groups that came back wrong are read again. a wpf
+ * without checksums is read again whole when its crc32 is off
+ */
+static void read_missing(Transfer *t)
+{
+    uint32_t from, to;
+    uint32_t groups = 0;
+    uint16_t bad;
+    int group;
+
+    t->state = TRANSFER_READ;
+    if (next_missing(t, &from, &to))
+    {
+        if (!queue_reads(t, t->buffer, t->base, from, to))
+            t->state = TRANSFER_FAILED;
+        return;
+    }
+
+    bad = check_wpf(t->buffer, t->size);
+    if (!bad && (!t->crc || crc32_update(0, t->buffer, t->size) == t->crc))
+    {
+        t->state = read_header(t) ? TRANSFER_DONE : TRANSFER_INVALID;
+        if (t->state == TRANSFER_DONE && !t->dir.legacy)
+        {
+            CachedRemote *c = cache_open(t->remote_addr, t->dir.generation, t->dir.crc);
+            cache_store(c, t->base, t->buffer, t->size);
+        }
+        return;
+    }
+    if (!bad)
+    {
+        if (stalled(t, 1))
+        {
+            printf("\n[ERROR] Remote %d: %s is corrupted on the remote\n", t->remote->unid, t->wpf_name);
+            t->state = TRANSFER_INVALID;
+            return;
+        }
+        mark_blocks(t, 0x00, t->size, 0);
+        if (t->stats)
+            t->stats->retries += (t->size + 15) / 16;
+        printf("\n[INFO] Remote %d: rereading %s, its crc32 is off\n", t->remote->unid, t->wpf_name);
+        read_missing(t);
+        return;
+    }
+    for (group = 0; bad >> group; group++)
+        groups += (bad >> group) & 1;
+    if (bad & WPF_BAD_HEADER || stalled(t, groups))
+    {
+        printf("\n[ERROR] Remote %d: %s is corrupted on the remote\n", t->remote->unid, t->wpf_name);
+        t->state = TRANSFER_INVALID;
+        return;
+    }
+
+    // the check block could be what is wrong, so it is read again as well
+    from = wpf_data_offset(t->buffer[12]);
+    mark_blocks(t, WPF_HEADER_SIZE, from, 0);
+    for (group = 0; bad >> group; group++)
+    {
+        uint32_t start = from + group * WPF_GROUP_SIZE;
+        if (bad & (1 << group))
+            mark_blocks(t, start, (t->size - start > WPF_GROUP_SIZE) ? start + WPF_GROUP_SIZE : t->size, 0);
+    }
+    if (t->stats)
+        t->stats->retries += (t->size - t->address + 15) / 16;
+    printf("\n[INFO] Remote %d: rereading groups that failed their checksum\n", t->remote->unid);
+    read_missing(t);
+}
+
+/**
+ * @brief window_read
+ *
+ * @param Transfer *t
+ *
+ * one queued read window has finished, windows finish in the order they were queued
+ */
+static void window_read(Transfer *t)
+{
+    uint32_t size = (t->end - t->cursor > READ_WINDOW) ? READ_WINDOW : t->end - t->cursor;
+
+    if (t->state == TRANSFER_READ)
+        mark_blocks(t, t->cursor, t->cursor + size, 1);
+    note_blocks(t, (size + 15) / 16);
+    t->cursor += size;
+    note_progress(t, 0, (size + 15) / 16);
+    if (t->cursor < t->end)
+        return;
+
+    switch (t->state)
+    {
+    case TRANSFER_DIRECTORY:
+        list_directory(t);
+        break;
+    case TRANSFER_HEADER:
+        list_legacy(t);
+        break;
+    case TRANSFER_READ:
+        read_missing(t);
+        break;
+    case TRANSFER_DIFF:
+        check_diff(t);
+        break;
+    case TRANSFER_BACKUP:
+        save_backup(t);
+        break;
+    case TRANSFER_VERIFY:
+        check_upload(t);
+        break;
+    case TRANSFER_COMMIT:
+        check_commit(t);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief step_transfer
+ *
+ * @param Transfer *t
+ *
+ * advances a transfer after its remote has been polled
+ */
+static void step_transfer(Transfer *t)
+{
+    switch (t->state)
+    {
+    case TRANSFER_DIRECTORY:
+    case TRANSFER_HEADER:
+    case TRANSFER_READ:
+    case TRANSFER_DIFF:
+    case TRANSFER_BACKUP:
+    case TRANSFER_VERIFY:
+        if (t->remote->event == WIIUSE_READ_DATA)
+            window_read(t);
+        break;
+    case TRANSFER_WRITE:
+        note_acks(t);
+        // a wpf with checksums is checked when it is downloaded, there is no need to read it back now,
+        // unless the remote failed to write some of it
+        if (t->blocks_acked >= t->blocks_queued && t->address >= t->size && !t->restore &&
+            (t->buffer[12] & WPF_FLAG_CHECKSUMS))
+        {
+            start_commit(t);
+            break;
+        }
+        // fall through
+    case TRANSFER_REWRITE:
+        note_acks(t);
+        if (t->blocks_acked >= t->blocks_queued)
+            start_verify(t);
+        break;
+    case TRANSFER_COMMIT:
+        note_acks(t);
+        // the directory is read back once every block of it is acked, blocks_queued is 0 from then on
+        if (t->blocks_queued && t->blocks_acked >= t->blocks_queued)
+        {
+            t->blocks_queued = 0;
+            if (!queue_reads(t, t->check_buf, DIR_ADDR, 0x00, DIR_SIZE))
+                t->state = TRANSFER_FAILED;
+        } else if (!t->blocks_queued && t->remote->event == WIIUSE_READ_DATA)
+        {
+            window_read(t);
+        }
+        break;
+    default:
+        return;
+    }
+
+    if (t->state == TRANSFER_DONE || t->state == TRANSFER_INVALID || t->state == TRANSFER_FAILED)
+        return;
+    if (!WIIMOTE_IS_CONNECTED(t->remote) || timed_out(t))
+    {
+        printf("\n[ERROR] Remote %d: process timed out. Restarting soon...\n", t->remote->unid);
+        t->state = TRANSFER_FAILED;
+    }
+}
+
+void init_listing(Transfer *t, wiimote *remote)
+{
+    uint32_t size = DIR_SIZE;
+
+    memset(t, 0, sizeof(Transfer));
+    t->remote  = remote;
+    t->listing = 1;
+    remote_address(remote, t->remote_addr);
+    start_clock(t);
+
+    // with the table in the cache, its header is enough to tell whether it changed
+    if (cache_load(cache_find(t->remote_addr), DIR_ADDR, t->check_buf, DIR_SIZE, NULL) == DIR_SIZE)
+        size = DIR_HEADER_SIZE;
+    // a remote that isn't connected has nothing to list
+    t->state = TRANSFER_DIRECTORY;
+    if (!queue_reads(t, t->check_buf, DIR_ADDR, 0x00, size))
+        t->state = TRANSFER_INVALID;
+}
+
+int init_upload(Transfer *t, wiimote *remote, WiimotePartialFile *metadata, Directory *dir,
+                JournalEntry *entry, int delta)
+{
+    CachedRemote *c;
+    DirEntry file;
+    int held, cached, dropped;
+
+    memset(t, 0, sizeof(Transfer));
+    t->remote = remote;
+    t->upload = 1;
+    remote_address(remote, t->remote_addr);
+    generate_wpf_file_name(t->wpf_name, metadata);
+    t->size = generate_wpf_buffer(t->buffer, metadata);
+    if (!t->size)
+        return 0;
+
+    // a wpf from before directories takes up the space the directory goes in, so it is written over
+    if (!dir->legacy)
+        t->dir = *dir;
+    memset(&file, 0, sizeof(DirEntry));
+    strcpy(file.name, metadata->file_name);
+    strcpy(file.ext, metadata->file_ext);
+    file.length = (uint16_t)t->size;
+    file.crc    = crc32_update(0, t->buffer, t->size);
+    file.part   = (uint16_t)metadata->cur_wpf;
+    file.parts  = (uint16_t)metadata->tot_wpf;
+
+    // the parts of an older version this remote lists under other part numbers go out with the new table
+    dropped = dir_drop(&t->dir, file.name, file.ext, file.part);
+
+    // the wpf's crc32 and length say what is in it, a remote listing the same ones holds it already
+    held = dir_find(&t->dir, file.name, file.ext, file.part);
+    if (held >= 0 && t->dir.entries[held].length == file.length && t->dir.entries[held].crc == file.crc)
+    {
+        t->base = t->dir.entries[held].offset;
+        t->crc  = file.crc;
+        mark_blocks(t, 0x00, t->size, 1);
+        printf("[INFO] Remote %d holds %s already\n", remote->unid, t->wpf_name);
+        if (!dropped)
+        {
+            t->state = TRANSFER_DONE;
+            return 1;
+        }
+        // only the table changes
+        t->dir.generation++;
+        start_clock(t);
+        start_commit(t);
+        return 1;
+    }
+    if (!dir_store(&t->dir, &file, delta))
+    {
+        printf("[INFO] Remote %d has no room left for %s\n", remote->unid, t->wpf_name);
+        return 0;
+    }
+    t->base = file.offset;
+    t->crc  = file.crc;
+    // the new table is told apart from the old one by its generation
+    t->dir.generation++;
+    // the wpf had to go in the Mii blocks, they are read off before anything is written over them
+    t->backup = !dir->mii_moved && t->dir.mii_moved;
+
+    // only worth reading first when the older version is there to compare against
+    t->delta = delta && held >= 0 && t->dir.entries[held].offset == t->base;
+
+    // pick up where the last run left off, as long as it was this same wpf in the same place. a file
+    // edited since could keep its size, but not its crc32
+    if (entry && entry->size == t->size && entry->base == t->base && entry->crc == t->crc &&
+        !strcmp(entry->wpf_name, t->wpf_name))
+    {
+        memcpy(t->blocks, entry->blocks, TRANSFER_BLOCK_BYTES);
+        mark_blocks(t, 0, 0, 1);
+        t->delta = 0;
+        printf("[INFO] Resuming %s at %dB\n", t->wpf_name, t->address);
+    }
+
+    // a copy of the older version saves reading it, and stops being one as soon as the first block goes out
+    c      = dir->legacy ? NULL : cache_open(t->remote_addr, dir->generation, dir->crc);
+    cached = t->delta && cache_load(c, t->base, t->check_buf, t->size, NULL) == t->size;
+    cache_forget(c, t->base, t->size);
+    cache_save();
+
+    start_clock(t);
+    if (cached && !t->backup)
+        check_diff(t);
+    else
+        start_upload(t);
+
+    return 1;
+}
+
+void init_download(Transfer *t, wiimote *remote, Directory *dir, DirEntry *file, JournalEntry *entry)
+{
+    CachedRemote *c;
+    uint32_t cached;
+
+    memset(t, 0, sizeof(Transfer));
+    t->remote = remote;
+    t->dir    = *dir;
+    t->base   = file->offset;
+    t->size   = file->length;
+    t->crc    = file->crc;
+    remote_address(remote, t->remote_addr);
+    sprintf_s(t->wpf_name, WPF_NAME_SIZE, "%s%s%d.wpf", file->name, file->ext, file->part);
+    start_clock(t);
+    printf("[INFO] Remote %d: file found: %s, %dB\n", remote->unid, t->wpf_name, t->size);
+
+    // the journal kept the blocks received so far, and knows which of them are good
+    if (entry && entry->size == t->size && entry->base == t->base && entry->crc == t->crc &&
+        !strcmp(entry->wpf_name, t->wpf_name))
+    {
+        memcpy(t->buffer, entry->data, t->size);
+        memcpy(t->blocks, entry->blocks, TRANSFER_BLOCK_BYTES);
+        mark_blocks(t, 0, 0, 1);
+        printf("[INFO] Resuming %s at %dB\n", t->wpf_name, t->address);
+    }
+
+    // nothing was written to the remote since the cache saw this generation, so what it holds needn't be read
+    if (!dir->legacy)
+    {
+        c      = cache_open(t->remote_addr, dir->generation, dir->crc);
+        cached = cache_load(c, t->base, t->buffer, t->size, t->blocks);
+        if (cached)
+        {
+            mark_blocks(t, 0, 0, 1);
+            printf("[INFO] Remote %d: %dB of %s are in the cache\n", remote->unid, cached, t->wpf_name);
+        }
+    }
+
+    read_missing(t);
+}
+
+int init_drop(Transfer *t, wiimote *remote, Directory *dir, char *name, char *ext)
+{
+    if (dir->legacy)
+        return 0;
+    memset(t, 0, sizeof(Transfer));
+    t->remote = remote;
+    t->upload = 1;
+    remote_address(remote, t->remote_addr);
+    t->dir = *dir;
+    if (!dir_drop(&t->dir, name, ext, 0))
+        return 0;
+    t->dir.generation++;
+    printf("[INFO] Remote %d: dropping the older version of %s%s%s\n", remote->unid, name, ext[0] ? "." : "",
+           ext);
+
+    start_clock(t);
+    start_commit(t);
+
+    return 1;
+}
+
+int init_restore(Transfer *t, wiimote *remote, Directory *dir)
+{
+    CachedRemote *c;
+    FILE *fp;
+    size_t read;
+    int dropped;
+
+    if (dir->legacy || !dir->mii_moved)
+        return 0;
+    memset(t, 0, sizeof(Transfer));
+    t->remote  = remote;
+    t->upload  = 1;
+    t->restore = 1;
+    remote_address(remote, t->remote_addr);
+    mii_backup_name(t->remote_addr, t->wpf_name);
+    if (fopen_s(&fp, t->wpf_name, "rb"))
+        return 0;
+    read = fread(t->buffer, sizeof(char), MII_SIZE, fp);
+    fclose(fp);
+    if (read != MII_SIZE)
+    {
+        printf("[ERROR] %s is cut short\n", t->wpf_name);
+        return 0;
+    }
+
+    t->dir  = *dir;
+    dropped = dir_free_mii(&t->dir);
+    t->dir.generation++;
+    t->base = MII_ADDR;
+    t->size = MII_SIZE;
+    printf("[INFO] Remote %d: restoring its Mii data, dropping the %d file(s) in its place\n", remote->unid,
+           dropped);
+
+    c = cache_open(t->remote_addr, dir->generation, dir->crc);
+    cache_forget(c, t->base, t->size);
+    cache_save();
+
+    start_clock(t);
+    start_writes(t);
+
+    return 1;
+}
+
+void resume_transfer(Transfer *t, wiimote *remote)
+{
+    TransferStats *stats = t->stats;
+    uint32_t requests    = t->requests;
+
+    t->remote = remote;
+    start_clock(t);
+    if (stats)
+        stats->retries += (t->size - t->address + 15) / 16;
+    if (t->listing)
+    {
+        // a listing is a single read, it is simplest to start it over
+        init_listing(t, remote);
+        t->stats    = stats;
+        t->requests = requests;
+    } else if (t->upload && !t->size)
+    {
+        // only the directory is being written
+        start_commit(t);
+    } else if (t->upload)
+    {
+        // with nothing left to write this goes straight on to verifying, or to the directory
+        start_upload(t);
+    } else
+    {
+        read_missing(t);
+    }
+}
+
+void remote_address(wiimote *remote, char *addr)
+{
+#if defined(WIIUSE_BLUEZ) || defined(WIIUSE_SIM)
+    strcpy(addr, remote->bdaddr_str);
+#else
+    // no address to go by, remotes are found in the same order every time
+    sprintf_s(addr, 18, "remote-%d", remote->unid);
+#endif
+}
+
+void mii_backup_name(char *remote_addr, char *name)
+{
+    int n = sprintf_s(name, 39, "mii-");
+
+    // not every file system takes the colons of an address
+    for (; *remote_addr && n < 34; remote_addr++)
+    {
+        if (*remote_addr != ':')
+            name[n++] = *remote_addr;
+    }
+    strcpy(name + n, ".bin");
+}
+
+wiimote *find_remote(wiimote **wiimotes, int count, char *addr)
+{
+    char cur[18];
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!wiimotes[i] || !WIIMOTE_IS_CONNECTED(wiimotes[i]))
+            continue;
+        remote_address(wiimotes[i], cur);
+        if (!strcmp(cur, addr))
+            return wiimotes[i];
+    }
+
+    return NULL;
+}
+
+int same_version(Transfer *a, Transfer *b)
+{
+    return a->tot_wpf == b->tot_wpf && a->stripe_k == b->stripe_k && a->file_size == b->file_size &&
+           a->file_crc == b->file_crc;
+}
+
+/**
+ * @brief enough_parts
+ *
+ * @param Transfer *transfers, int count
+ *
+ * @returns 1 if the finished downloads hold enough parts of one version of a striped file to rebuild it
+ */
+static int enough_parts(Transfer *transfers, int count)
+{
+    int i, j;
+
+    for (i = 0; i < count; i++)
+    {
+        Transfer *t   = &transfers[i];
+        uint32_t seen = 0;
+        int parts     = 0;
+        if (t->upload || t->state != TRANSFER_DONE || !t->stripe_k)
+            continue;
+        for (j = 0; j < count; j++)
+        {
+            Transfer *p = &transfers[j];
+            if (p->upload || p->state != TRANSFER_DONE || !same_version(t, p) || (seen & (1u << p->cur_wpf)))
+                continue;
+            seen |= 1u << p->cur_wpf;
+            parts++;
+        }
+        if (parts >= t->stripe_k)
+            return 1;
+    }
+
+    return 0;
+}
+
+int run_transfers(Transfer *transfers, int count)
+{
+    wiimote *remotes[MAX_WIIMOTES];
+    char *title    = (count && transfers[0].upload) ? "UPLOAD PROGRESS:" : "DATA DOWNLOADED:";
+    int active     = count;
+    int alerting   = 0;
+    uint32_t done  = 0, shown = 0;
+    uint64_t saved = wiiuse_ticks_us();
+    int i;
+
+    for (i = 0; i < count; i++)
+        remotes[i] = transfers[i].remote;
+
+    // the remotes that finish first play their alert while the others carry on
+    while (active || alerting)
+    {
+        wiiuse_poll_timeout(remotes, count, POLL_TIMEOUT);
+
+        if (active)
+        {
+            active = 0;
+            done   = 0;
+            for (i = 0; i < count; i++)
+            {
+                step_transfer(&transfers[i]);
+                if (transfers[i].state < TRANSFER_DONE)
+                    active++;
+                done += progress_of(&transfers[i]);
+            }
+            // the slowest remotes of a striped file are not needed
+            if (active && enough_parts(transfers, count))
+                active = 0;
+            if (done != shown)
+            {
+                print_progress(transfers, count, title);
+                shown = done;
+                if (wiiuse_ticks_us() - saved >= JOURNAL_INTERVAL)
+                {
+                    journal_save(transfers, count);
+                    saved = wiiuse_ticks_us();
+                }
+            }
+        }
+
+        alerting = 0;
+        for (i = 0; i < count; i++)
+            alerting += step_alert(&transfers[i]);
+    }
+    journal_save(transfers, count);
+    cache_save();
+    printf("\n");
+
+    active = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (transfers[i].state != TRANSFER_DONE)
+            active++;
+    }
+
+    return enough_parts(transfers, count) ? 0 : active;
+}
@@ -0,0 +1,281 @@
+/**
+ * transfer
+ *
+ * purpose: to move .wpf data on and off of wii remotes.
+ *      every remote gets a Transfer, which walks through
+ *      reading its directory, or reading or writing one
+ *      of the wpfs the directory lists, one step at a time.
+ *      run_transfers polls all remotes in a single loop
+ *      and advances each Transfer as its reports arrive,
+ *      so every remote works on its part at the same time
+ */
+#ifndef TRANSFER_H
+#define TRANSFER_H
+#include <stdint.h>
+
+#include "wiiuse.h"
+
+#include "directory.h"
+#include "wpf_handler.h"
+
+#define MAX_WIIMOTES 4
+#define TRANSFER_BLOCKS ((MAX_WIIMOTE_PAYLOAD + 15) / 16)
+#define TRANSFER_BLOCK_BYTES ((TRANSFER_BLOCKS + 7) / 8)
+
+struct JournalEntry;
+
+// what a transfer cost, kept only when a benchmark asks for it
+typedef struct TransferStats
+{
+    uint32_t retries;     // blocks that had to be read or written again
+    uint64_t last_us;     // when the last block came through
+    uint32_t *latency_us; // how long each block took to come through, one after the other
+    uint32_t samples;
+    uint32_t capacity;
+} TransferStats;
+
+// how long a remote takes per report, smoothed the way tcp does it
+typedef struct RoundTrip
+{
+    uint32_t srtt_us;
+    uint32_t rttvar_us;
+} RoundTrip;
+
+typedef enum TransferState
+{
+    TRANSFER_DIRECTORY, // reading the remote's directory
+    TRANSFER_HEADER,    // reading the header of a wpf on a remote without a directory
+    TRANSFER_READ,      // streaming the wpf off the remote
+    TRANSFER_DIFF,      // reading what the remote holds where the wpf goes, to write only what changed
+    TRANSFER_BACKUP,    // reading the Mii blocks, to keep their data on the host before a wpf takes them
+    TRANSFER_WRITE,     // writing the wpf to the remote
+    TRANSFER_VERIFY,    // reading the written wpf back
+    TRANSFER_REWRITE,   // writing the blocks that failed to verify again
+    TRANSFER_COMMIT,    // writing the directory that lists the written wpf, and reading it back
+    TRANSFER_DONE,
+    TRANSFER_FAILED, // timed out, resume from address once reconnected
+    TRANSFER_INVALID // the remote holds no wpf, nothing to resume
+} TransferState;
+
+typedef struct Transfer
+{
+    wiimote *remote;
+    char remote_addr[18];
+    int upload;  // 1 when sending the wpf, 0 when receiving it
+    int listing; // 1 when only reading the directory
+    int delta;   // 1 while an upload still has to find out which blocks the remote holds already
+    int backup;  // 1 while an upload still has to keep the Mii blocks it goes in on the host
+    int restore; // 1 when writing the Mii data kept on the host back, rather than a wpf
+    TransferState state;
+
+    // the remote's directory, with the uploaded wpf added once it is written
+    Directory dir;
+
+    // the wpf being moved, header included
+    char wpf_name[WPF_NAME_SIZE];
+    char buffer[MAX_WIIMOTE_PAYLOAD];
+    char check_buf[MAX_WIIMOTE_PAYLOAD];
+    uint32_t base; // where the wpf is in the eeprom
+    uint32_t size;
+    uint32_t crc; // crc32 of the whole wpf, 0 when the directory doesn't know it
+    // every 16 byte block that is on the remote, or in buffer for downloads
+    uint8_t blocks[TRANSFER_BLOCK_BYTES];
+    // how many bytes of those blocks there are
+    uint32_t address;
+
+    // the reads in flight cover cursor up to end
+    uint32_t cursor;
+    uint32_t end;
+    uint32_t requests; // read and write requests sent
+
+    // the writes in flight, sent as one vectored write of up to a run per block
+    struct wiiuse_iovec_t writes[TRANSFER_BLOCKS];
+    int write_runs; // runs added since the last vectored write was sent
+    unsigned int blocks_queued;
+    unsigned int blocks_acked;
+    // the block each write in flight belongs to, and how it went, in the order they were sent
+    uint16_t write_blocks[TRANSFER_BLOCKS];
+    byte write_status[TRANSFER_BLOCKS];
+
+    // read back passes in a row that left as many blocks wrong as the one before
+    int passes;
+    uint32_t last_bad;
+
+    // how long the remote takes to answer, acks and read reports come at different paces
+    RoundTrip write_rtt;    // per acked write
+    RoundTrip read_rtt;     // per report of a read
+    uint32_t rto_us;        // how long to wait for the next answer, doubled every time it runs out
+    int backoffs;           // times rto_us ran out since the last answer
+    unsigned int replies;   // the remote's reply count when the wait started
+    uint64_t last_progress; // wiiuse_ticks_us of the last block through
+    uint64_t deadline;      // wiiuse_ticks_us when rto_us runs out
+    int leds;
+    int alert_step;       // how far the remote is through its alert, once done
+    uint64_t alert_at;    // wiiuse_ticks_us when the next step of the alert is due
+    TransferStats *stats; // NULL unless benchmarking
+
+    // filled in from the header of a downloaded wpf
+    char file_name[17];
+    char file_ext[17];
+    int file_size;
+    uint32_t file_crc; // crc32 of the whole file, 0 when the wpf has no check block
+    int cur_wpf;
+    int tot_wpf;
+    int stripe_k; // any stripe_k of the tot_wpf parts rebuild a striped file
+} Transfer;
+
+/**
+ * @brief init_listing
+ *
+ * @param Transfer* t - the transfer to set up
+ * @param wiimote* remote - the remote to list
+ *
+ * reads the directory of a remote into t->dir. a remote without
+ * one gets the wpf it holds at address 0 listed, if it holds any
+ */
+void init_listing(Transfer *t, wiimote *remote);
+
+/**
+ * @brief init_upload
+ *
+ * @param Transfer* t - the transfer to set up
+ * @param wiimote* remote - the remote receiving the wpf
+ * @param WiimotePartialFile* metadata - prepared with prepare_data, cur_wpf picks the part
+ * @param Directory* dir - the remote's directory, from a listing
+ * @param JournalEntry* entry - the journaled progress of this wpf, may be NULL
+ * @param int delta - 1 to write over the older version of the wpf, and only the blocks that differ from it
+ *
+ * @returns 1 on success, 0 on failure
+ *
+ * builds a whole wpf in memory so it can be written to a remote, in
+ * the first extent of the directory it fits in. blocks the journal
+ * has as written are skipped. the directory is written last, without
+ * the parts of an older version of the file the remote lists. when
+ * the directory lists this exact wpf already only that is left to do.
+ * a wpf that only fits in the Mii blocks reads them into a backup first
+ */
+int init_upload(Transfer *t, wiimote *remote, WiimotePartialFile *metadata, Directory *dir,
+                struct JournalEntry *entry, int delta);
+
+/**
+ * @brief init_download
+ *
+ * @param Transfer* t - the transfer to set up
+ * @param wiimote* remote - the remote holding the wpf
+ * @param Directory* dir - the remote's directory, from a listing
+ * @param DirEntry* file - the wpf to read, one of the entries of dir
+ * @param JournalEntry* entry - the journaled progress of this remote, may be NULL
+ *
+ * prepares to read a wpf off a remote, picking up from the
+ * blocks the journal kept when it has them. the blocks
+ * the cache holds at the directory's generation aren't read
+ */
+void init_download(Transfer *t, wiimote *remote, Directory *dir, DirEntry *file, struct JournalEntry *entry);
+
+/**
+ * @brief init_drop
+ *
+ * @param Transfer* t - the transfer to set up
+ * @param wiimote* remote - the remote to change
+ * @param Directory* dir - the remote's directory, from a listing
+ * @param char* name, char* ext - the file to drop
+ *
+ * @returns 1 if the remote listed the file and its directory is being written without it, 0 if not
+ *
+ * only writes the directory, the wpfs it drops are left where they are
+ * until an upload needs their room
+ */
+int init_drop(Transfer *t, wiimote *remote, Directory *dir, char *name, char *ext);
+
+/**
+ * @brief init_restore
+ *
+ * @param Transfer* t - the transfer to set up
+ * @param wiimote* remote - the remote to restore
+ * @param Directory* dir - the remote's directory, from a listing
+ *
+ * @returns 1 if the remote's Mii data is being written back, 0 if the host has none kept for it
+ *
+ * writes the Mii blocks kept by an upload back where they came from,
+ * dropping the wpfs that took their place from the directory
+ */
+int init_restore(Transfer *t, wiimote *remote, Directory *dir);
+
+/**
+ * @brief mii_backup_name
+ *
+ * @param char* remote_addr - the address from remote_address
+ * @param char* name - an array of length 39 to save the file name to
+ *
+ * names the file a remote's Mii blocks are kept in while wpfs take their place
+ */
+void mii_backup_name(char *remote_addr, char *name);
+
+/**
+ * @brief resume_transfer
+ *
+ * @param Transfer* t - a transfer that failed
+ * @param wiimote* remote - the reconnected remote
+ *
+ * points a failed transfer at its reconnected remote, it picks up again from its address
+ */
+void resume_transfer(Transfer *t, wiimote *remote);
+
+/**
+ * @brief save_transfer
+ *
+ * @param Transfer* t - a finished download
+ *
+ * @returns 1 on success, 0 on failure
+ *
+ * writes the downloaded wpf to disk, for staging it offline
+ */
+int save_transfer(Transfer *t);
+
+/**
+ * @brief remote_address
+ *
+ * @param wiimote* remote - a connected remote
+ * @param char* addr - an array of length 18 to save the address to
+ *
+ * names a remote the same way across reconnects and restarts
+ */
+void remote_address(wiimote *remote, char *addr);
+
+/**
+ * @brief find_remote
+ *
+ * @param wiimote** wiimotes - the connected remotes
+ * @param int count - the number of remotes
+ * @param char* addr - the address from remote_address
+ *
+ * @returns the connected remote with that address, or NULL
+ */
+wiimote *find_remote(wiimote **wiimotes, int count, char *addr);
+
+/**
+ * @brief same_version
+ *
+ * @param Transfer* a, Transfer* b - finished downloads
+ *
+ * @returns 1 if both parts are of the same version of the file, 0 if not
+ *
+ * a remote left out of an upload can still hold a part of an older
+ * version, which can't be stitched in with the newer one
+ */
+int same_version(Transfer *a, Transfer *b);
+
+/**
+ * @brief run_transfers
+ *
+ * @param Transfer* transfers - the transfers to run
+ * @param int count - the number of transfers
+ *
+ * @returns the number of transfers that are not done, 0 once a striped file can be rebuilt
+ *
+ * drives every transfer at once, until each one is done, failed, or invalid.
+ * downloads of a striped file stop as soon as enough parts are in
+ */
+int run_transfers(Transfer *transfers, int count);
+
+#endif
@@ -17,12 +17,90 @@
 
 #include "wpf_handler.h"
 
+#include "directory.h"
+#include "file_map.h"
+#include "lz.h"
+#include "rs.h"
+
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
-#define MAX_FILE_SIZE 5312
+#define MAX_FILE_SIZE (DIR_CAPACITY - WPF_HEADER_SIZE) // a whole wpf has to fit in the room a directory leaves
+
+static uint16_t convert_to_uint16(uint8_t *p_value)
+{
+    uint32_t least_sig       = (0x0000 | p_value[1]);
+    uint32_t most_sig        = (0x0000 | p_value[0]) << 8;
+    uint32_t converted_value = least_sig | most_sig;
+    return converted_value;
+}
+
+static uint32_t convert_to_uint32(uint8_t *p_value)
+{
+    uint32_t least_sig        = (0x00000000 | p_value[3]);
+    uint32_t second_least_sig = (0x00000000 | p_value[2]) << 8;
+    uint32_t second_most_sig  = (0x00000000 | p_value[1]) << 16;
+    uint32_t most_sig         = (0x00000000 | p_value[0]) << 24;
+    uint32_t converted_value  = (least_sig | second_least_sig) | (second_most_sig | most_sig);
+    return converted_value;
+}
+
+static void convert_from_uint32(uint32_t value, char *p_value)
+{
+    p_value[0] = (char)(value >> 24);
+    p_value[1] = (char)(value >> 16);
+    p_value[2] = (char)(value >> 8);
+    p_value[3] = (char)value;
+}
+
+uint32_t crc32_update(uint32_t crc, char *data, uint32_t len)
+{
+    static uint32_t table[256];
+    static int table_ready = 0;
+    uint32_t i;
+
+    // the standard reflected crc32, the table is built the first time through
+    if (!table_ready)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            int bit;
+            for (bit = 0; bit < 8; bit++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        table_ready = 1;
+    }
+
+    crc = ~crc;
+    for (i = 0; i < len; i++)
+        crc = table[(crc ^ (uint8_t)data[i]) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+uint32_t wpf_data_offset(int flags)
+{
+    return (flags & WPF_FLAG_CHECKSUMS) ? WPF_HEADER_SIZE + WPF_CHECK_SIZE : WPF_HEADER_SIZE;
+}
+
+uint32_t wpf_file_crc(char *wpf)
+{
+    return (wpf[12] & WPF_FLAG_CHECKSUMS) ? convert_to_uint32((uint8_t *)wpf + WPF_HEADER_SIZE) : 0;
+}
+
+/**
+ * @brief part_capacity
+ *
+ * @param int flags
+ *
+ * @returns the most payload one wpf can carry, the check block takes its room out of the payload
+ */
+static uint32_t part_capacity(int flags) { return MAX_FILE_SIZE + WPF_HEADER_SIZE - wpf_data_offset(flags); }
 
 int get_file_name2(char *file_name, WiimotePartialFile *wpf)
 {
@@ -50,7 +128,11 @@ int get_file_name2(char *file_name, WiimotePartialFile *wpf)
     if (ext_index < last_slash_index)
     {
         file_len = ((int)strlen(file_name)) - last_slash_index;
+        ext_len  = 0;
     }
+    // the header only has room for 16 characters of each
+    if (file_len > 16 || ext_len > 16)
+        return 0;
 
     // write filename
     i = 0;
@@ -104,10 +186,14 @@ int32_t find_size(char *file_name, WiimotePartialFile *wpf)
     return res;
 }
 
-int prepare_data(char *file_name, WiimotePartialFile *wpf)
+int prepare_data(char *file_name, char *source, uint32_t size, WiimotePartialFile *wpf)
 {
     // sets tot file size
-    int size = (int)find_size(file_name, wpf);
+    wpf->file_size = size;
+    wpf->flags     = WPF_FLAG_CHECKSUMS;
+    wpf->stripe_k  = 0;
+    wpf->stripes   = NULL;
+    wpf->file_crc  = crc32_update(0, source, size);
     if (!size)
     {
         printf("[ERROR] Invalid file size\n");
@@ -121,23 +207,86 @@ int prepare_data(char *file_name, WiimotePartialFile *wpf)
         return 0;
     }
 
+    // compress the file, only keeping it if it came out smaller
+    wpf->payload      = source;
+    wpf->payload_size = size;
+    char *compressed  = malloc(size);
+    uint32_t packed   = compressed ? lz_compress((uint8_t *)source, size, (uint8_t *)compressed, size - 1) : 0;
+    if (packed)
+    {
+        printf("[INFO] Compressed %dB down to %dB\n", size, packed);
+        wpf->payload      = compressed;
+        wpf->payload_size = packed;
+        wpf->flags |= WPF_FLAG_COMPRESSED;
+    } else
+    {
+        free(compressed);
+    }
+
     // sets total wpfs, and cur wpf size
-    int total_wpfs = (int)ceil(((float)size) / ((float)MAX_FILE_SIZE));
+    int total_wpfs = (int)ceil(((float)wpf->payload_size) / ((float)part_capacity(wpf->flags)));
     wpf->tot_wpf   = total_wpfs;
     wpf->cur_wpf   = 1;
     // set cur wpf size
     if (total_wpfs == 1) // if only one wpf, then set size = file size
     {
-        wpf->cur_wpf_size = size;
+        wpf->cur_wpf_size = wpf->payload_size;
     } else
     {
-        wpf->cur_wpf_size = MAX_FILE_SIZE;
+        wpf->cur_wpf_size = part_capacity(wpf->flags);
     }
 
     return 1;
 }
 
-int generate_header(FILE *wpf_file, WiimotePartialFile *metadata)
+int stripe_data(WiimotePartialFile *wpf, int parity)
+{
+    uint32_t capacity = part_capacity(wpf->flags);
+    uint32_t blocks   = (wpf->payload_size + 15) / 16;
+    uint8_t *parts[RS_MAX_PARTS];
+    uint32_t b, len;
+    int k, i;
+
+    // as many data parts as an unstriped upload would need, plus the parity
+    k = (int)((wpf->payload_size + capacity - 1) / capacity);
+    if (parity < 1 || k + parity > RS_MAX_PARTS || k > 255)
+    {
+        printf("[ERROR] Can not stripe %d parts with %d parity parts\n", k, parity);
+        return 0;
+    }
+    len          = ((blocks + k - 1) / k) * 16;
+    wpf->stripes = calloc((size_t)(k + parity), len);
+    if (!wpf->stripes)
+        return 0;
+
+    // 16 byte blocks are dealt out to the data parts in turn
+    for (b = 0; b < blocks; b++)
+    {
+        uint32_t size = (wpf->payload_size - b * 16 > 16) ? 16 : wpf->payload_size - b * 16;
+        memcpy(wpf->stripes + (b % k) * len + (b / k) * 16, wpf->payload + b * 16, size);
+    }
+    for (i = 0; i < k + parity; i++)
+        parts[i] = (uint8_t *)wpf->stripes + i * len;
+    rs_encode(parts, k, parts + k, parity, len);
+
+    wpf->stripe_k     = k;
+    wpf->tot_wpf      = k + parity;
+    wpf->cur_wpf      = 1;
+    wpf->cur_wpf_size = len;
+
+    return 1;
+}
+
+void release_data(WiimotePartialFile *wpf)
+{
+    if (wpf->flags & WPF_FLAG_COMPRESSED)
+        free(wpf->payload);
+    free(wpf->stripes);
+    wpf->payload = NULL;
+    wpf->stripes = NULL;
+}
+
+int generate_header_buffer(char *buffer, WiimotePartialFile *metadata)
 {
     char header_buf[16] = {(metadata->file_size >> 24),
                            (metadata->file_size << 8) >> 24,
@@ -149,140 +298,556 @@ int generate_header(FILE *wpf_file, WiimotePartialFile *metadata)
                            (metadata->cur_wpf_size << 16) >> 24,
                            (metadata->cur_wpf_size << 24) >> 24,
 
-                           ((metadata->tot_wpf) >> 8) << 8,
+                           (metadata->tot_wpf) >> 8,
                            ((metadata->tot_wpf) << 8) >> 8,
-                           ((metadata->cur_wpf) >> 8) << 8,
+                           (metadata->cur_wpf) >> 8,
                            ((metadata->cur_wpf) << 8) >> 8,
-                           0x00,
-                           0x00,
+                           metadata->flags,
+                           metadata->stripe_k,
                            0x00,
                            0x00};
 
-    fwrite(header_buf, sizeof(char), 16, wpf_file);
-    fwrite(metadata->file_name, sizeof(char), 16, wpf_file);
-    fwrite(metadata->file_ext, sizeof(char), 16, wpf_file);
+    memcpy(buffer, header_buf, 16);
+    memcpy(buffer + 0x10, metadata->file_name, 16);
+    memcpy(buffer + 0x20, metadata->file_ext, 16);
+
+    return 1;
+}
+
+int generate_header(FILE *wpf_file, WiimotePartialFile *metadata)
+{
+    char header_buf[WPF_HEADER_SIZE];
+
+    generate_header_buffer(header_buf, metadata);
+    fwrite(header_buf, sizeof(char), WPF_HEADER_SIZE, wpf_file);
+
+    return 1;
+}
+
+uint32_t generate_wpf_buffer(char *buffer, WiimotePartialFile *metadata)
+{
+    uint32_t capacity = part_capacity(metadata->flags);
+    uint32_t offset   = (uint32_t)(metadata->cur_wpf - 1) * capacity;
+    char *data        = buffer + wpf_data_offset(metadata->flags);
+    int group;
+
+    if (metadata->stripe_k)
+    {
+        // striped parts are all the same size, and were built by stripe_data
+        if (metadata->cur_wpf < 1 || metadata->cur_wpf > metadata->tot_wpf)
+            return 0;
+        generate_header_buffer(buffer, metadata);
+        memcpy(data, metadata->stripes + (metadata->cur_wpf - 1) * metadata->cur_wpf_size, metadata->cur_wpf_size);
+    } else
+    {
+        // every part is full, except for the last one
+        if (metadata->cur_wpf < 1 || offset >= metadata->payload_size)
+        {
+            printf("[ERROR] wpf %d is past the end of the file\n", metadata->cur_wpf);
+            return 0;
+        }
+        metadata->cur_wpf_size = metadata->payload_size - offset;
+        if ((uint32_t)metadata->cur_wpf_size > capacity)
+            metadata->cur_wpf_size = capacity;
+
+        // the part is just a slice of the payload
+        generate_header_buffer(buffer, metadata);
+        memcpy(data, metadata->payload + offset, metadata->cur_wpf_size);
+    }
+
+    // the check block follows the header: the file crc, the part crc, one crc per group, then the payload size
+    if (metadata->flags & WPF_FLAG_CHECKSUMS)
+    {
+        char *check = buffer + WPF_HEADER_SIZE;
+        memset(check, 0, WPF_CHECK_SIZE);
+        convert_from_uint32(metadata->file_crc, check);
+        convert_from_uint32(crc32_update(0, data, metadata->cur_wpf_size), check + 4);
+        convert_from_uint32(metadata->payload_size, check + WPF_CHECK_SIZE - 12);
+        for (group = 0; group * WPF_GROUP_SIZE < metadata->cur_wpf_size; group++)
+        {
+            uint32_t len = metadata->cur_wpf_size - group * WPF_GROUP_SIZE;
+            if (len > WPF_GROUP_SIZE)
+                len = WPF_GROUP_SIZE;
+            convert_from_uint32(crc32_update(0, data + group * WPF_GROUP_SIZE, len), check + 8 + group * 4);
+        }
+    }
+
+    return wpf_data_offset(metadata->flags) + metadata->cur_wpf_size;
+}
+
+int generate_wpf(char *wpf_name, WiimotePartialFile *metadata)
+{
+    FileMap wpf_file;
+    uint32_t capacity = part_capacity(metadata->flags);
+    uint32_t offset   = (uint32_t)(metadata->cur_wpf - 1) * capacity;
+    uint32_t size     = metadata->payload_size - offset;
+
+    if (metadata->stripe_k)
+        size = metadata->cur_wpf_size;
+    else if (metadata->cur_wpf < 1 || offset >= metadata->payload_size)
+        return 0;
+    if (size > capacity)
+        size = capacity;
+
+    // the wpf is sized up front, and the part is copied straight into it
+    if (!map_new_file(&wpf_file, wpf_name, wpf_data_offset(metadata->flags) + size))
+    {
+        printf("[ERROR] Could not create/write to .wpf %s\n", wpf_name);
+        return 0;
+    }
+    generate_wpf_buffer(wpf_file.data, metadata);
+    unmap_file(&wpf_file);
 
     return 1;
 }
 
-int generate_wpf(FILE *fp, FILE *wpf_file, WiimotePartialFile *metadata)
+int read_wpf_header(char *buffer, WiimotePartialFile *metadata)
 {
-    if (!generate_header(wpf_file, metadata))
+    int i;
+
+    metadata->file_size    = convert_to_uint32((uint8_t *)buffer);
+    metadata->cur_wpf_size = convert_to_uint32((uint8_t *)buffer + 4);
+    metadata->tot_wpf      = convert_to_uint16((uint8_t *)buffer + 8);
+    metadata->cur_wpf      = convert_to_uint16((uint8_t *)buffer + 10);
+    metadata->flags        = (uint8_t)buffer[12];
+    metadata->stripe_k     = (uint8_t)buffer[13];
+    if (metadata->stripe_k > metadata->tot_wpf || metadata->tot_wpf > (metadata->stripe_k ? RS_MAX_PARTS : 0xffff))
+        return 0;
+    if (metadata->cur_wpf_size <= 0 || (uint32_t)metadata->cur_wpf_size > part_capacity(metadata->flags) ||
+        metadata->cur_wpf < 1 ||
+        metadata->cur_wpf > metadata->tot_wpf)
     {
-        printf("[ERROR] Could not generate header\n");
         return 0;
     }
 
-    char buffer[MAX_FILE_SIZE];
-    fread(buffer, metadata->cur_wpf_size, sizeof(char), fp);
-    fwrite(buffer, metadata->cur_wpf_size, sizeof(char), wpf_file);
+    // read file NAME and EXTENSION, both are padded out with 0xcc
+    for (i = 0; i < 16 && buffer[0x10 + i] != -52 && buffer[0x10 + i]; i++)
+        metadata->file_name[i] = buffer[0x10 + i];
+    metadata->file_name[i] = 0;
+    for (i = 0; i < 16 && buffer[0x20 + i] != -52 && buffer[0x20 + i]; i++)
+        metadata->file_ext[i] = buffer[0x20 + i];
+    metadata->file_ext[i] = 0;
 
     return 1;
 }
 
+uint16_t check_wpf(char *wpf, uint32_t size)
+{
+    WiimotePartialFile part;
+    char part_name[17];
+    char part_ext[17];
+    uint16_t bad = 0;
+    char *data;
+    int group;
+
+    part.file_name = part_name;
+    part.file_ext  = part_ext;
+    if (size < WPF_HEADER_SIZE || !read_wpf_header(wpf, &part) ||
+        wpf_data_offset(part.flags) + part.cur_wpf_size > size)
+        return WPF_BAD_HEADER;
+    if (!(part.flags & WPF_FLAG_CHECKSUMS))
+        return 0;
+
+    data = wpf + wpf_data_offset(part.flags);
+    for (group = 0; group * WPF_GROUP_SIZE < part.cur_wpf_size; group++)
+    {
+        uint32_t len = part.cur_wpf_size - group * WPF_GROUP_SIZE;
+        if (len > WPF_GROUP_SIZE)
+            len = WPF_GROUP_SIZE;
+        if (crc32_update(0, data + group * WPF_GROUP_SIZE, len) !=
+            convert_to_uint32((uint8_t *)wpf + WPF_HEADER_SIZE + 8 + group * 4))
+            bad |= (1 << group);
+    }
+
+    return bad;
+}
+
 int generate_wpf_file_name(char *buffer, WiimotePartialFile *metadata)
 {
-    sprintf_s(buffer, 39, "%s%s%d.wpf", metadata->file_name, metadata->file_ext, metadata->cur_wpf);
+    sprintf_s(buffer, WPF_NAME_SIZE, "%s%s%d.wpf", metadata->file_name, metadata->file_ext,
+              metadata->cur_wpf);
 
     return 1;
 }
 
 int create_wpf_files(char *file_name, WiimotePartialFile *metadata)
 {
-    FILE *fp;      // the file to read from
-    FILE *cur_wpf; // the current wpf to write to
+    FileMap source; // the file to read from
 
     // open file
-    if (fopen_s(&fp, file_name, "rb"))
+    if (!map_file(&source, file_name))
     {
         printf("[ERROR] Could not open file %s for reading\n", file_name);
         return 0;
     }
     // init metadata
-    if (!prepare_data(file_name, metadata))
+    if (!prepare_data(file_name, source.data, source.size, metadata))
     {
+        unmap_file(&source);
         return 0;
     }
     // generate file_data
-    char wpf_name[39]; // will hold the wpf file name
-    while (metadata->cur_wpf <= metadata->tot_wpf)
+    char wpf_name[WPF_NAME_SIZE]; // will hold the wpf file name
+    for (metadata->cur_wpf = 1; metadata->cur_wpf <= metadata->tot_wpf; metadata->cur_wpf++)
     {
-        if (!generate_wpf_file_name(wpf_name, metadata))
+        generate_wpf_file_name(wpf_name, metadata);
+        printf("[INFO] Staging %s\n", wpf_name);
+        if (!generate_wpf(wpf_name, metadata))
         {
             printf("[ERROR] Failed to create .wpf file. Failure at wpf num %d out of %d\n", metadata->cur_wpf,
                    metadata->tot_wpf);
+            release_data(metadata);
+            unmap_file(&source);
             return 0;
         }
-        if (fopen_s(&cur_wpf, wpf_name, "wb"))
-        {
-            printf("[ERROR] Could not create/write to .wpf %s\n", file_name);
-            return 0;
-        }
-        generate_wpf(fp, cur_wpf, metadata);
-
-        if (metadata->tot_wpf == 1)
-        {
-            fclose(cur_wpf);
-            break;
-        }
-
-        metadata->cur_wpf_size = metadata->file_size - (MAX_FILE_SIZE * metadata->cur_wpf);
-        metadata->cur_wpf++;
-        fclose(cur_wpf);
     }
 
-    fclose(fp);
+    release_data(metadata);
+    unmap_file(&source);
     return metadata->tot_wpf;
 }
 
-int stitch_together_wpfs(WiimotePartialFile *wpf)
+/**
+ * @brief open_stitched_file
+ *
+ * @param WiimotePartialFile* wpf - the wpf holding the original file name
+ * @param uint32_t size - the size of the original file
+ * @param FileMap* map - the map to open the file in
+ * @param char* name - filled in with the original file's name, 35 chars
+ * @param char* temp_name - filled in with the name it is stitched under, 41 chars
+ *
+ * @returns 1 on success, 0 on failure
+ *
+ * creates the file the parts are copied into at its full size. it only takes the
+ * original file's name once every part checks out, so a copy of the file that is
+ * already there isn't lost to a download that goes wrong
+ */
+static int open_stitched_file(WiimotePartialFile *wpf, uint32_t size, FileMap *map, char *name,
+                              char *temp_name)
 {
-    FILE *stitched_file;
-    char stitched_file_name[34];
     if (wpf->file_ext[0] != 0)
-        sprintf_s(stitched_file_name, 35, "%s.%s", wpf->file_name, wpf->file_ext);
+        sprintf_s(name, 35, "%s.%s", wpf->file_name, wpf->file_ext);
     else
-        sprintf_s(stitched_file_name, 35, "%s", wpf->file_name);
+        sprintf_s(name, 35, "%s", wpf->file_name);
+    sprintf_s(temp_name, 41, "%s.part", name);
     // open our file for writing
-    if (fopen_s(&stitched_file, stitched_file_name, "wb"))
+    if (!map_new_file(map, temp_name, size))
     {
-        printf("[ERROR] Could not create file %s for stitching.\n", stitched_file_name);
+        printf("[ERROR] Could not create file %s for stitching.\n", temp_name);
         return 0;
     }
-    printf("[INFO] Creating file %s\n", stitched_file_name);
+    printf("[INFO] Creating file %s\n", name);
+
+    return 1;
+}
+
+/**
+ * @brief Stitcher
+ *
+ * puts the parts back in place as they come in. uncompressed parts go
+ * straight into the original file, compressed ones are gathered up
+ * and expanded into it once every part is in. striped files keep
+ * every part until the data parts can be rebuilt from them
+ */
+typedef struct Stitcher
+{
+    FileMap file;
+    char name[35];
+    char temp_name[41];
+    char *payload;
+    uint32_t payload_cap;
+    uint32_t payload_size;
+    int flags;
+    uint32_t file_crc;
+    int tot_wpf;
+    int parts;
+
+    int stripe_k;
+    uint32_t stripe_len;
+    char *stripes;
+    uint8_t have[RS_MAX_PARTS];
+} Stitcher;
+
+/**
+ * @brief start_stitch
+ *
+ * @param Stitcher *st, WiimotePartialFile *wpf, char *header
+ *
+ * @returns 1 on success, 0 on failure
+ *
+ * opens the original file, using the header of any of its wpfs
+ */
+static int start_stitch(Stitcher *st, WiimotePartialFile *wpf, char *header)
+{
+    WiimotePartialFile part;
+    char part_name[17];
+    char part_ext[17];
+
+    part.file_name = part_name;
+    part.file_ext  = part_ext;
+    memset(st, 0, sizeof(Stitcher));
+    if (!read_wpf_header(header, &part))
+        return 0;
+    // striped files need the check block for their payload size
+    if (part.stripe_k && !(part.flags & WPF_FLAG_CHECKSUMS))
+        return 0;
+    if (!open_stitched_file(wpf, part.file_size, &st->file, st->name, st->temp_name))
+        return 0;
+
+    st->flags    = part.flags;
+    st->tot_wpf  = part.tot_wpf;
+    st->stripe_k = part.stripe_k;
+    if (st->flags & WPF_FLAG_CHECKSUMS)
+    {
+        st->file_crc     = convert_to_uint32((uint8_t *)header + WPF_HEADER_SIZE);
+        st->payload_size = convert_to_uint32((uint8_t *)header + WPF_HEADER_SIZE + WPF_CHECK_SIZE - 12);
+    }
+    if (st->stripe_k)
+    {
+        st->stripe_len = part.cur_wpf_size;
+        st->stripes    = calloc(st->tot_wpf, st->stripe_len);
+        st->payload_cap = st->payload_size;
+    } else
+    {
+        st->payload_cap = (uint32_t)st->tot_wpf * part_capacity(st->flags);
+    }
+
+    if (!(st->flags & WPF_FLAG_COMPRESSED))
+    {
+        st->payload_cap = st->file.size;
+        st->payload     = st->file.data;
+    } else
+    {
+        st->payload = malloc(st->payload_cap ? st->payload_cap : 1);
+    }
+    if (!st->payload || (st->stripe_k && !st->stripes))
+    {
+        if (st->flags & WPF_FLAG_COMPRESSED)
+            free(st->payload);
+        free(st->stripes);
+        unmap_file(&st->file);
+        remove(st->temp_name);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief stitch_part
+ *
+ * @param Stitcher *st, char *wpf, uint32_t size
+ *
+ * @returns 1 on success, 0 if the wpf doesn't belong in the file
+ */
+static int stitch_part(Stitcher *st, char *wpf, uint32_t size)
+{
+    WiimotePartialFile part;
+    char part_name[17];
+    char part_ext[17];
+    uint32_t offset;
+
+    part.file_name = part_name;
+    part.file_ext  = part_ext;
+    if (size < WPF_HEADER_SIZE || !read_wpf_header(wpf, &part) || part.flags != st->flags ||
+        part.stripe_k != st->stripe_k || part.tot_wpf != st->tot_wpf)
+        return 0;
+    if (wpf_data_offset(part.flags) + part.cur_wpf_size > size || check_wpf(wpf, size))
+        return 0;
+
+    if (st->stripe_k)
+    {
+        if ((uint32_t)part.cur_wpf_size != st->stripe_len)
+            return 0;
+        memcpy(st->stripes + (part.cur_wpf - 1) * st->stripe_len, wpf + wpf_data_offset(part.flags),
+               st->stripe_len);
+        st->have[part.cur_wpf - 1] = 1;
+        st->parts++;
+        return 1;
+    }
+
+    // the header says where the part goes
+    offset = (uint32_t)(part.cur_wpf - 1) * part_capacity(part.flags);
+    if (offset + part.cur_wpf_size > st->payload_cap)
+        return 0;
+    memcpy(st->payload + offset, wpf + wpf_data_offset(part.flags), part.cur_wpf_size);
+    if (!(st->flags & WPF_FLAG_CHECKSUMS) && offset + part.cur_wpf_size > st->payload_size)
+        st->payload_size = offset + part.cur_wpf_size;
+    st->parts++;
+
+    return 1;
+}
+
+/**
+ * @brief unstripe
+ *
+ * @param Stitcher *st
+ *
+ * @returns 1 on success, 0 if too many parts are missing
+ *
+ * rebuilds the data parts from whichever parts came in, and deals
+ * their blocks back out into the payload
+ */
+static int unstripe(Stitcher *st)
+{
+    uint8_t *parts[RS_MAX_PARTS];
+    uint8_t *data[RS_MAX_PARTS];
+    char *rebuilt = malloc((size_t)st->stripe_k * st->stripe_len);
+    uint32_t b;
+    int i;
+
+    if (!rebuilt)
+        return 0;
+    for (i = 0; i < st->tot_wpf; i++)
+        parts[i] = st->have[i] ? (uint8_t *)st->stripes + i * st->stripe_len : NULL;
+    for (i = 0; i < st->stripe_k; i++)
+        data[i] = (uint8_t *)rebuilt + i * st->stripe_len;
+    if (!rs_reconstruct(parts, st->stripe_k, st->tot_wpf, st->stripe_len, data))
+    {
+        printf("[ERROR] Only %d of the %d wpfs needed are here\n", st->parts, st->stripe_k);
+        free(rebuilt);
+        return 0;
+    }
+
+    for (b = 0; b * 16 < st->payload_size; b++)
+    {
+        uint32_t size = (st->payload_size - b * 16 > 16) ? 16 : st->payload_size - b * 16;
+        uint32_t at   = (b / st->stripe_k) * 16;
+        if (b * 16 + size > st->payload_cap || at + size > st->stripe_len)
+            break;
+        memcpy(st->payload + b * 16, data[b % st->stripe_k] + at, size);
+    }
+    free(rebuilt);
+
+    return b * 16 >= st->payload_size;
+}
+
+/**
+ * @brief finish_stitch
+ *
+ * @param Stitcher *st, int ok
+ *
+ * @returns 1 on success, 0 on failure
+ *
+ * rebuilds a striped file, expands a compressed file, and closes the original file.
+ * it takes the original file's name if everything checked out, and is removed if not
+ */
+static int finish_stitch(Stitcher *st, int ok)
+{
+    if (ok && st->stripe_k)
+    {
+        ok = unstripe(st);
+    } else if (ok && st->parts < st->tot_wpf)
+    {
+        printf("[ERROR] Only %d of the %d wpfs are here\n", st->parts, st->tot_wpf);
+        ok = 0;
+    }
+    if (ok && (st->flags & WPF_FLAG_COMPRESSED))
+    {
+        uint32_t size = lz_decompress((uint8_t *)st->payload, st->payload_size, (uint8_t *)st->file.data,
+                                      st->file.size);
+        if (size != st->file.size)
+        {
+            printf("[ERROR] The downloaded file could not be decompressed\n");
+            ok = 0;
+        }
+    }
+    if (ok && (st->flags & WPF_FLAG_CHECKSUMS) && crc32_update(0, st->file.data, st->file.size) != st->file_crc)
+    {
+        printf("[ERROR] The stitched file does not match the checksum it was uploaded with\n");
+        ok = 0;
+    }
+    if (st->flags & WPF_FLAG_COMPRESSED)
+        free(st->payload);
+    free(st->stripes);
+    unmap_file(&st->file);
+
+#ifdef _WIN32
+    // rename won't replace a file on windows
+    if (ok)
+        remove(st->name);
+#endif
+    if (ok && rename(st->temp_name, st->name))
+    {
+        printf("[ERROR] Could not rename %s to %s\n", st->temp_name, st->name);
+        ok = 0;
+    }
+    if (!ok)
+        remove(st->temp_name);
+
+    return ok;
+}
+
+int stitch_together_buffers(WiimotePartialFile *wpf, char **parts, uint32_t *sizes, int count)
+{
+    Stitcher st;
+    int started = 0;
+    int i;
+
+    // every part is copied straight out of its buffer, minus the header. striped files can be missing some
+    for (i = 0; i < wpf->tot_wpf && i < count; i++)
+    {
+        if (!parts[i])
+            continue;
+        if (!started && !start_stitch(&st, wpf, parts[i]))
+            return 0;
+        started = 1;
+        if (!stitch_part(&st, parts[i], sizes[i]))
+        {
+            printf("[ERROR] wpf %d is corrupted, please redownload\n", i + 1);
+            return finish_stitch(&st, 0);
+        }
+    }
+    if (!started)
+        return 0;
+
+    return finish_stitch(&st, 1);
+}
+
+int stitch_together_wpfs(WiimotePartialFile *wpf)
+{
+    Stitcher st;
+    FileMap wpf_file;
+    char wpf_name[WPF_NAME_SIZE];
+    int started = 0;
 
-    // begin stitching files
-    wpf->cur_wpf = 1;
-    char wpf_name[39];
-    char write_buffer[MAX_FILE_SIZE];
-    FILE *wpf_file;
     // run through all .wpf files downloaded and stitch together
-    while (wpf->cur_wpf <= wpf->tot_wpf)
+    for (wpf->cur_wpf = 1; wpf->cur_wpf <= wpf->tot_wpf; wpf->cur_wpf++)
     {
-        // ensure the file exists, if not, exit app
+        // a missing wpf is only fatal once we know the file is not striped
         generate_wpf_file_name(wpf_name, wpf);
-        if (fopen_s(&wpf_file, wpf_name, "rb"))
+        if (!map_file(&wpf_file, wpf_name))
         {
             printf("[ERROR] Could not read .wpf file %s. If missing, please redownload. If locked, please "
                    "close the program currently reading it.\n",
                    wpf_name);
+            continue;
+        }
+        // the first header also says how big the file is
+        if (!started && (wpf_file.size < WPF_HEADER_SIZE || !start_stitch(&st, wpf, wpf_file.data)))
+        {
+            unmap_file(&wpf_file);
             return 0;
         }
+        started = 1;
         printf("[INFO] Stitching file %s\n", wpf_name);
-        // use the returned size, not wpf->cur_wpf_size, this func doesnt set that value
-        int wpf_size = (int)find_size(wpf_name, wpf);
-        // skip the first 0x30 data
-        fread(write_buffer, sizeof(char), 0x30, wpf_file);
-        fread(write_buffer, sizeof(char), wpf_size - 0x30, wpf_file);
-        // write to the buffer
-        fwrite(write_buffer, sizeof(char), wpf_size - 0x30, stitched_file);
-        // close and remove the wpf
-        fclose(wpf_file);
+        if (!stitch_part(&st, wpf_file.data, wpf_file.size))
+        {
+            printf("[ERROR] .wpf file %s is corrupted, please redownload\n", wpf_name);
+            unmap_file(&wpf_file);
+            return finish_stitch(&st, 0);
+        }
+        unmap_file(&wpf_file);
+    }
+    if (!started || !finish_stitch(&st, 1))
+        return 0;
+
+    // only a file that checked out can do without the wpfs it came from
+    for (wpf->cur_wpf = 1; wpf->cur_wpf <= wpf->tot_wpf; wpf->cur_wpf++)
+    {
+        generate_wpf_file_name(wpf_name, wpf);
         remove(wpf_name);
-        wpf->cur_wpf++;
     }
-    // close and exit
-    fclose(stitched_file);
 
     return 1;
-}
\ No newline at end of file
+}
@@ -20,6 +20,19 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "compat.h"
+
+#define WPF_HEADER_SIZE 0x30
+#define WPF_NAME_SIZE 48 // a 16 character name and extension, any part number, ".wpf" and the terminator
+
+#define WPF_CHECK_SIZE 0x40  // the check block after the header, when WPF_FLAG_CHECKSUMS is set
+#define WPF_GROUP_SIZE 0x200 // the payload bytes covered by each crc in the check block
+#define WPF_BAD_HEADER 0x8000
+
+// flags kept in byte 12 of the header
+#define WPF_FLAG_COMPRESSED 0x01 // the parts together hold the file compressed with lz_compress
+#define WPF_FLAG_CHECKSUMS 0x02  // a check block of crc32s follows the header
+
 typedef struct WiimotePartialFile
 {
     // these nums are used for the first line of the header
@@ -32,6 +45,17 @@ typedef struct WiimotePartialFile
     // file name and type
     char *file_name;
     char *file_ext;
+
+    // the data split across the wpfs, the file itself or a compressed copy of it
+    char *payload;
+    uint32_t payload_size;
+    int flags;
+    // crc32 of the whole original file
+    uint32_t file_crc;
+    // how many of the parts are data when striped, 0 when the parts are plain slices
+    int stripe_k;
+    // every striped part, cur_wpf_size bytes each
+    char *stripes;
 } WiimotePartialFile;
 
 /**
@@ -40,7 +64,7 @@ typedef struct WiimotePartialFile
  * @param char* file_name - the file name we are breaking down
  * @param WiimotePartialFile* wpf - the wpf to save the gathered data to
  *
- * @returns 1 on success, 0 on failure
+ * @returns 1 on success, 0 if the name or extension is longer than 16 characters
  *
  * prepares the file name for the wpf
  */
@@ -62,13 +86,40 @@ int32_t find_size(char *file_name, WiimotePartialFile *wpf);
  * @brief prepare_data
  *
  * @param char* file_name - the file we are reading from
+ * @param char* source - the contents of the file
+ * @param uint32_t size - the size of the file
  * @param WiimotePartialFile* wpf - the wpf to save the gathered data to
  *
  * @returns 1 on success, 0 on failure
  *
- * prepares a wpf pointer with data gathered from a preparation of data
+ * prepares a wpf pointer with data gathered from a preparation of data.
+ * the file is compressed when that makes it smaller, so it needs fewer
+ * remotes. release_data frees the payload once the wpfs are generated
  */
-int prepare_data(char *file_name, WiimotePartialFile *wpf);
+int prepare_data(char *file_name, char *source, uint32_t size, WiimotePartialFile *wpf);
+
+/**
+ * @brief stripe_data
+ *
+ * @param WiimotePartialFile* wpf - a wpf from prepare_data
+ * @param int parity - how many parity parts to add
+ *
+ * @returns 1 on success, 0 on failure
+ *
+ * deals the payload out over equally sized data parts and adds
+ * reed-solomon parity parts, so any of the data part count of
+ * parts can rebuild the file. tot_wpf grows by the parity parts
+ */
+int stripe_data(WiimotePartialFile *wpf, int parity);
+
+/**
+ * @brief release_data
+ *
+ * @param WiimotePartialFile* wpf - a wpf from prepare_data
+ *
+ * frees the compressed payload and the striped parts, if there are any
+ */
+void release_data(WiimotePartialFile *wpf);
 
 /**
  * @brief generate_header
@@ -83,22 +134,98 @@ int prepare_data(char *file_name, WiimotePartialFile *wpf);
 int generate_header(FILE *wpf_file, WiimotePartialFile *metadata);
 
 /**
- * @brief generate_wpf
+ * @brief generate_header_buffer
  *
- * @param FILE* fp - the file we are reading from
- * @param FILE* wpf_file - the wpf file we are writing to
+ * @param char* buffer - at least WPF_HEADER_SIZE bytes to write the header to
  * @param WiimotePartialFile* metadata - the wpf containing info on our current wpf
  *
  * @returns 1 on success, 0 on failure
  *
+ * the same header generate_header writes, built in memory
+ */
+int generate_header_buffer(char *buffer, WiimotePartialFile *metadata);
+
+/**
+ * @brief generate_wpf_buffer
+ *
+ * @param char* buffer - a buffer big enough for a whole wpf, header included
+ * @param WiimotePartialFile* metadata - prepared with prepare_data, cur_wpf picks the part
+ *
+ * @returns the size of the wpf in buffer, 0 on failure
+ *
+ * builds the current wpf straight into memory, so it can be sent
+ * without a .wpf file ever being written. sets cur_wpf_size
+ */
+uint32_t generate_wpf_buffer(char *buffer, WiimotePartialFile *metadata);
+
+/**
+ * @brief read_wpf_header
+ *
+ * @param char* buffer - the first WPF_HEADER_SIZE bytes of a wpf
+ * @param WiimotePartialFile* metadata - the wpf to save the header to,
+ *      file_name and file_ext need room for 17 chars
+ *
+ * @returns 1 on success, 0 if the header is not valid
+ */
+int read_wpf_header(char *buffer, WiimotePartialFile *metadata);
+
+/**
+ * @brief crc32_update
+ *
+ * @param uint32_t crc - 0 to start, or the crc of the data before this
+ * @param char* data - the data to add to the crc
+ * @param uint32_t len - the length of the data
+ *
+ * @returns the crc32 of everything so far
+ */
+uint32_t crc32_update(uint32_t crc, char *data, uint32_t len);
+
+/**
+ * @brief wpf_data_offset
+ *
+ * @param int flags - the flags from the wpf header
+ *
+ * @returns where the payload starts in a wpf
+ */
+uint32_t wpf_data_offset(int flags);
+
+/**
+ * @brief wpf_file_crc
+ *
+ * @param char* wpf - a whole wpf, header included
+ *
+ * @returns the crc32 of the whole original file from the check block, 0 when the wpf has none
+ */
+uint32_t wpf_file_crc(char *wpf);
+
+/**
+ * @brief check_wpf
+ *
+ * @param char* wpf - a whole wpf, header included
+ * @param uint32_t size - the size of the wpf
+ *
+ * @returns 0 if the wpf is intact, or has no checksums. otherwise bit n is set
+ *      for every WPF_GROUP_SIZE group of the payload whose crc doesn't match,
+ *      and WPF_BAD_HEADER if the header itself is unusable
+ */
+uint16_t check_wpf(char *wpf, uint32_t size);
+
+/**
+ * @brief generate_wpf
+ *
+ * @param char* wpf_name - the wpf file we are writing to
+ * @param WiimotePartialFile* metadata - prepared with prepare_data, cur_wpf picks the part
+ *
+ * @returns 1 on success, 0 on failure
+ *
  * using our current wpf, we fill a wpf file with all necessary info
  */
-int generate_wpf(FILE *fp, FILE *wpf_file, WiimotePartialFile *metadata);
+int generate_wpf(char *wpf_name, WiimotePartialFile *metadata);
 
 /**
  * @brief generate_wpf_file_name
  *
- * @param char* buffer - an array of length 39 to save the new file name to
+ * @param char* buffer - an array of length WPF_NAME_SIZE to save the new file name to
  * @param WiimotePartialFile* metadata - the wpf containing info on our current wpf
  *
  * @returns 1 on success, 0 on failure
@@ -115,10 +242,26 @@ int generate_wpf_file_name(char *buffer, WiimotePartialFile *metadata);
  * @returns 1 on success, 0 on failure
  *
  * Takes a file, and generates a number of wpf files.
- * It will return the number of wpfs necessary to upload data
+ * It will return the number of wpfs necessary to upload data.
+ * Only needed to stage wpfs offline, uploads build them in memory
  */
 int create_wpf_files(char *file_name, WiimotePartialFile *metadata);
 
+/**
+ * @brief stitch_together_buffers
+ *
+ * @param WiimotePartialFile* wpf - the wpf containing info necessary to redownload the image
+ * @param char** parts - every downloaded wpf, header included, in order
+ * @param uint32_t* sizes - the size of each wpf in parts
+ * @param int count - the length of parts and sizes, parts past it count as missing
+ *
+ * @returns 1 on success, 0 on failure
+ *
+ * the same as stitch_together_wpfs, but straight from the
+ *      download buffers instead of .wpf files
+ */
+int stitch_together_buffers(WiimotePartialFile *wpf, char **parts, uint32_t *sizes, int count);
+
 /**
  * @brief stitch_together_wpfs
  *
@@ -129,7 +272,7 @@ int create_wpf_files(char *file_name, WiimotePartialFile *metadata);
  * Using the WPF struct generated from downloaded data, creates a
  *      file that will have the same name as the OG file
  * It will read from the .wpf files downloaded, splice them into the
- *      generated file, and remove the .wpfs
+ *      generated file, and remove the .wpfs once the file checks out
  */
 int stitch_together_wpfs(WiimotePartialFile *wpf);
 